@@ -0,0 +1,132 @@
+#!/bin/bash
+# 6 nodes in two meshes contending with EDCA, with aggregation
+# nodes 0-3 share 2412 MHz, a best effort flow 0->1 against a voice flow
+# 2->3 that may burst within its TXOP; nodes 4-5 on 2437 MHz do not
+# contend with them.
+
+num_nodes=6
+session=wmediumd
+subnet=10.10.10
+macfmt='02:00:00:00:%02x:00'
+
+. func
+
+if [[ $UID -ne 0 ]]; then
+	echo "Sorry, run me as root."
+	exit 1
+fi
+
+modprobe -r mac80211_hwsim
+modprobe mac80211_hwsim radios=$num_nodes
+
+for i in `seq 0 $((num_nodes-1))`; do
+	addrs[$i]=`printf $macfmt $i`
+done
+
+cat <<__EOM > diamond.cfg
+ifaces :
+{
+	ids = [
+		"02:00:00:00:00:00",
+		"02:00:00:00:01:00",
+		"02:00:00:00:02:00",
+		"02:00:00:00:03:00",
+		"02:00:00:00:04:00",
+		"02:00:00:00:05:00"
+	];
+
+	contention = "edca";
+	aggregation = true;
+};
+
+model:
+{
+	type = "snr";
+	links = (
+		(0, 1, 30),
+		(0, 2, 30),
+		(0, 3, 30),
+		(1, 2, 30),
+		(1, 3, 30),
+		(2, 3, 30),
+		(0, 4, 30),
+		(1, 4, 30),
+		(2, 4, 30),
+		(3, 4, 30),
+		(0, 5, 30),
+		(1, 5, 30),
+		(2, 5, 30),
+		(3, 5, 30),
+		(4, 5, 30)
+	);
+};
+__EOM
+
+tmux new -s $session -d
+
+rm /tmp/netns.pid.* 2>/dev/null
+i=0
+for addr in ${addrs[@]}; do
+	phy=`addr2phy $addr`
+	dev=`ls /sys/class/ieee80211/$phy/device/net`
+	phys[$i]=$phy
+	devs[$i]=$dev
+
+	ip=${subnet}.$((10 + i))
+
+	# put this phy in own netns and tmux window, and start a mesh node
+	win=$session:$((i+1)).0
+	tmux new-window -t $session -n $ip
+
+	# start netns
+	pidfile=/tmp/netns.pid.$i
+	tmux send-keys -t $win 'lxc-unshare -s NETWORK /bin/bash' C-m
+	tmux send-keys -t $win 'echo $$ > '$pidfile C-m
+
+	# wait for netns to exist
+	while [[ ! -e $pidfile ]]; do
+		echo "Waiting for netns $i -- $pidfile"
+		sleep 0.5
+	done
+
+	tmux send-keys -t $session:0.0 'iw phy '$phy' set netns `cat '$pidfile'`' C-m
+
+	# wait for phy to exist in netns
+	while [[ -e /sys/class/ieee80211/$phy ]]; do
+		echo "Waiting for $phy to move to netns..."
+		sleep 0.5
+	done
+
+	# start mesh node
+	tmux send-keys -t $win '. func' C-m
+	if [[ $i -lt 4 ]]; then
+		tmux send-keys -t $win 'meshup-iw '$dev' edca0 2412 '$ip C-m
+	else
+		tmux send-keys -t $win 'meshup-iw '$dev' edca1 2437 '$ip C-m
+	fi
+
+	i=$((i+1))
+done
+winct=$i
+
+# start wmediumd
+win=$session:$((winct+1)).0
+winct=$((winct+1))
+tmux new-window -a -t $session -n wmediumd
+tmux send-keys -t $win '../wmediumd/wmediumd -c diamond.cfg' C-m
+
+# start iperf servers on 10.10.10.11, 10.10.10.13 and 10.10.10.15
+tmux send-keys -t $session:2 'iperf -s -u' C-m
+tmux send-keys -t $session:4 'iperf -s -u' C-m
+tmux send-keys -t $session:6 'iperf -s -u' C-m
+
+# enable monitor
+tmux send-keys -t $session:0 'ip link set hwsim0 up' C-m
+
+# best effort, voice (TOS 0xb8 maps to AC_VO) and the other channel
+tmux send-keys -t $session:1 'ping -c 5 10.10.10.11 && iperf -c 10.10.10.11 -u -b 100M -i 5 -t 60' C-m
+tmux send-keys -t $session:3 'ping -c 5 10.10.10.13 && iperf -c 10.10.10.13 -u -b 100M -S 0xb8 -i 5 -t 60' C-m
+tmux send-keys -t $session:5 'ping -c 5 10.10.10.15 && iperf -c 10.10.10.15 -u -b 100M -i 5 -t 60' C-m
+
+tmux select-window -t $session:1
+tmux attach
@@ -0,0 +1,451 @@
+/*
+ * Checks of the medium model that run without mac80211_hwsim.
+ *
+ * The scheduler lives in static functions of wmediumd.c, so it is built
+ * into this program with its main() renamed.  The stations and links are
+ * set up by hand instead of from a config file.
+ */
+
+#define main wmediumd_main
+#include "../wmediumd/wmediumd.c"
+#undef main
+
+#define TEST_MAX_STAS	64
+
+static int test_snr[TEST_MAX_STAS][TEST_MAX_STAS];
+
+static int test_link_snr(struct wmediumd *ctx, struct station *sender,
+			 struct station *receiver)
+{
+	return test_snr[sender->index][receiver->index];
+}
+
+static double test_error_prob(struct wmediumd *ctx, double snr,
+			      unsigned int rate_idx, int frame_len,
+			      struct station *src, struct station *dst)
+{
+	return 0.0;
+}
+
+static int test_no_fading(struct wmediumd *ctx, struct station *src,
+			  struct station *dst, struct rng_stream *rng)
+{
+	return 0;
+}
+
+/* stations that all hear each other with a good link */
+static void test_init(struct wmediumd *ctx, int num_stas, bool edca)
+{
+	struct station *station;
+	int i, j;
+
+	memset(ctx, 0, sizeof(*ctx));
+	INIT_LIST_HEAD(&ctx->stations);
+	ctx->timerfd = -1;
+	ctx->num_stas = num_stas;
+	ctx->sta_array = calloc(num_stas, sizeof(*ctx->sta_array));
+	ctx->link_epoch = 1;
+	ctx->edca_contention = edca;
+	ctx->get_link_snr = test_link_snr;
+	ctx->get_error_prob = test_error_prob;
+	ctx->get_fading_signal = test_no_fading;
+
+	for (i = 0; i < num_stas; i++) {
+		station = calloc(1, sizeof(*station));
+		station->index = i;
+		station->addr[0] = 0x02;
+		station->addr[4] = i;
+		memcpy(station->hwaddr, station->addr, ETH_ALEN);
+		station->freq = 2412;
+		station_init_queues(station);
+		list_add_tail(&station->list, &ctx->stations);
+		ctx->sta_array[i] = station;
+
+		for (j = 0; j < num_stas; j++)
+			test_snr[i][j] = 30;
+	}
+}
+
+static void test_free(struct wmediumd *ctx)
+{
+	struct station *station, *tmp;
+	struct frame *frame, *ftmp;
+	int i;
+
+	list_for_each_entry_safe(station, tmp, &ctx->stations, list) {
+		for (i = 0; i < IEEE80211_NUM_ACS; i++) {
+			list_for_each_entry_safe(frame, ftmp,
+						 &station->queues[i].frames,
+						 list)
+				free(frame);
+		}
+		free(station->cca_neighbors);
+		free(station);
+	}
+	for (i = 0; i < ctx->num_media; i++) {
+		edca_free(ctx->media[i]->edca);
+		free(ctx->media[i]);
+	}
+	free(ctx->media);
+	free(ctx->sta_array);
+}
+
+/* queue a data frame from src to dst, or to everybody if dst is NULL */
+static struct frame *test_send(struct wmediumd *ctx, struct station *src,
+			       struct station *dst, int len, int count)
+{
+	static const u8 bcast[ETH_ALEN] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+	struct ieee80211_hdr *hdr;
+	struct frame *frame;
+	int i;
+
+	frame = calloc(1, sizeof(*frame) + len);
+	hdr = (void *)frame->data;
+	hdr->frame_control[0] = 0x08;
+	memcpy(hdr->addr1, dst ? dst->addr : bcast, ETH_ALEN);
+	memcpy(hdr->addr2, src->addr, ETH_ALEN);
+
+	frame->data_len = len;
+	frame->sender = src;
+	frame->freq = src->freq;
+	frame->tx_rates_count = IEEE80211_TX_MAX_RATES;
+	for (i = 0; i < IEEE80211_TX_MAX_RATES; i++) {
+		frame->tx_rates[i].idx = -1;
+		frame->tx_rates[i].count = -1;
+	}
+	frame->tx_rates[0].idx = 0;
+	frame->tx_rates[0].count = count;
+
+	queue_frame(ctx, src, frame);
+	return frame;
+}
+
+static u64 frame_end(struct frame *frame)
+{
+	return timespec_to_usec(&frame->expires);
+}
+
+static u64 frame_start(struct frame *frame)
+{
+	return frame_end(frame) - frame->airtime;
+}
+
+/*
+ * B and C do not hear each other and send at the same time, C ends
+ * first.  A hears both and must wait for B.
+ */
+static int test_hidden_station_tail(void)
+{
+	struct wmediumd ctx;
+	struct station *a, *b, *c;
+	struct frame *fa, *fb;
+	int ret = 0;
+
+	test_init(&ctx, 3, false);
+	a = ctx.sta_array[0];
+	b = ctx.sta_array[1];
+	c = ctx.sta_array[2];
+	test_snr[1][2] = -50;
+	test_snr[2][1] = -50;
+
+	fb = test_send(&ctx, b, a, 1500, 1);
+	test_send(&ctx, c, a, 100, 1);
+	fa = test_send(&ctx, a, b, 100, 1);
+
+	if (frame_start(fa) < frame_end(fb)) {
+		fprintf(stderr, "%s: A starts at %llu before B ends at %llu\n",
+			__func__, (unsigned long long)frame_start(fa),
+			(unsigned long long)frame_end(fb));
+		ret = -1;
+	}
+	test_free(&ctx);
+	return ret;
+}
+
+/*
+ * A station that did not send yet may be on any channel and acks, one
+ * known to be on another channel does not.
+ */
+static int test_unknown_channel(void)
+{
+	struct wmediumd ctx;
+	struct frame *unknown, *other;
+	int ret = 0;
+
+	test_init(&ctx, 3, false);
+	ctx.sta_array[1]->freq = FREQ_UNKNOWN;
+	ctx.sta_array[2]->freq = 2437;
+
+	unknown = test_send(&ctx, ctx.sta_array[0], ctx.sta_array[1], 100, 1);
+	other = test_send(&ctx, ctx.sta_array[0], ctx.sta_array[2], 100, 1);
+
+	if (!(unknown->flags & HWSIM_TX_STAT_ACK)) {
+		fprintf(stderr, "%s: no ack on an unknown channel\n",
+			__func__);
+		ret = -1;
+	}
+	if (other->flags & HWSIM_TX_STAT_ACK) {
+		fprintf(stderr, "%s: ack from another channel\n", __func__);
+		ret = -1;
+	}
+	test_free(&ctx);
+	return ret;
+}
+
+/*
+ * Collision probability of saturated stations in Bianchi's model, the
+ * fixed point of p = 1 - (1 - tau)^(n - 1) with the attempt rate
+ * tau = 2 / (1 + W + p * W * sum (2p)^k for k < m)
+ */
+static double bianchi_collision_prob(int n, int w, int m)
+{
+	double lo = 0.0, hi = 1.0, p = 0.5, tau, sum, pk;
+	int i, k;
+
+	for (i = 0; i < 60; i++) {
+		p = (lo + hi) / 2.0;
+		sum = 0.0;
+		pk = 1.0;
+		for (k = 0; k < m; k++) {
+			sum += pk;
+			pk *= 2.0 * p;
+		}
+		tau = 2.0 / (1.0 + w + p * w * sum);
+		if (1.0 - pow(1.0 - tau, n - 1) > p)
+			lo = p;
+		else
+			hi = p;
+	}
+	return p;
+}
+
+/*
+ * Saturated best effort queues that all hear each other collide as often
+ * as Bianchi's model predicts for their contention window.
+ */
+static int test_edca_saturation_n(int n)
+{
+	const int depth = 1500, horizon = 2000000;
+	struct wmediumd ctx;
+	struct station *station;
+	struct medium *medium;
+	struct frame *frame;
+	struct wqueue *queue;
+	long attempts = 0, successes = 0;
+	double p, expected;
+	int i, m, ret = 0;
+
+	test_init(&ctx, n, true);
+	for (i = 0; i < depth * n; i++)
+		test_send(&ctx, ctx.sta_array[i % n],
+			  ctx.sta_array[(i + 1) % n], 100, 255);
+	medium = ctx.media[0];
+	edca_run(&ctx, medium, medium->free + horizon);
+
+	for (i = 0; i < n; i++) {
+		station = ctx.sta_array[i];
+		queue = &station->queues[IEEE80211_AC_BE];
+		if (!edca_next_frame(queue)) {
+			fprintf(stderr, "%s: station %d ran out of frames\n",
+				__func__, i);
+			ret = -1;
+		}
+		list_for_each_entry(frame, &queue->frames, list) {
+			attempts += frame->attempts;
+			if (frame->flags & HWSIM_TX_STAT_ACK)
+				successes++;
+		}
+	}
+
+	queue = &ctx.sta_array[0]->queues[IEEE80211_AC_BE];
+	for (m = 0; (queue->cw_min + 1) << m <= queue->cw_max; m++)
+		;
+	expected = bianchi_collision_prob(n, queue->cw_min + 1, m);
+	p = 1.0 - (double)successes / attempts;
+	if (fabs(p - expected) > 0.03) {
+		fprintf(stderr, "%s: %d stations collide with p = %.3f, expected %.3f\n",
+			__func__, n, p, expected);
+		ret = -1;
+	}
+
+	test_free(&ctx);
+	return ret;
+}
+
+static int test_edca_saturation(void)
+{
+	return test_edca_saturation_n(5) | test_edca_saturation_n(10) |
+	       test_edca_saturation_n(20);
+}
+
+/*
+ * Broadcasts that collide are lost and not retried, they are never acked
+ * so nothing tells the senders to try again.
+ */
+static int test_edca_broadcast_collision(void)
+{
+	struct wmediumd ctx;
+	struct frame *frames[2];
+	struct medium *medium;
+	int i, ret = 0;
+
+	test_init(&ctx, 2, true);
+	for (i = 0; i < 2; i++) {
+		ctx.sta_array[i]->queues[IEEE80211_AC_BE].cw_min = 0;
+		ctx.sta_array[i]->queues[IEEE80211_AC_BE].cw_max = 0;
+	}
+
+	/* both get ready while the medium is busy and expire together */
+	medium = get_medium(&ctx, 2412);
+	medium->free = timespec_to_usec(&(struct timespec){ .tv_sec = 1 << 30 });
+	for (i = 0; i < 2; i++)
+		frames[i] = test_send(&ctx, ctx.sta_array[i], NULL, 100, 4);
+	edca_run(&ctx, medium, medium->free + 10000);
+
+	for (i = 0; i < 2; i++) {
+		if (!frames[i]->scheduled || frames[i]->attempts != 1 ||
+		    (frames[i]->flags & HWSIM_TX_STAT_ACK) ||
+		    frames[i]->tx_rates[0].count != 1) {
+			fprintf(stderr, "%s: broadcast %d sent %d times, %s\n",
+				__func__, i, frames[i]->attempts,
+				frames[i]->flags & HWSIM_TX_STAT_ACK ?
+				"delivered" : "lost");
+			ret = -1;
+		}
+	}
+
+	test_free(&ctx);
+	return ret;
+}
+
+/*
+ * Stations added to and removed from a path loss model get the SNRs of
+ * their positions, and the resized state still follows later moves.
+ */
+static int test_path_loss_add_del(void)
+{
+	static const u8 addr[ETH_ALEN] = { 0x02, 0x00, 0x00, 0x00, 0x10, 0x00 };
+	struct log_distance_model_param param = {
+		.path_loss_exponent = 3.5,
+		.PL0 = log_distance_reference_loss(),
+	};
+	struct wmediumd ctx;
+	int snr10, snr20, i, ret = 0;
+
+	test_init(&ctx, 3, false);
+	for (i = 0; i < 3; i++) {
+		ctx.sta_array[i]->x = 10.0 * i;
+		ctx.sta_array[i]->tx_power = SNR_DEFAULT;
+	}
+	ctx.path_loss_param = &param;
+	ctx.calc_path_loss_row = calc_path_loss_row_log_distance;
+	ctx.calc_path_loss_range = calc_path_loss_range_log_distance;
+	ctx.move_stations = move_stations_to_direction;
+	ctx.snr_matrix = calloc(3 * 3, sizeof(int));
+	if (init_path_loss(&ctx, 1, 0.0))
+		return -1;
+	snr10 = ctx.snr_matrix[0 * 3 + 1];
+	snr20 = ctx.snr_matrix[0 * 3 + 2];
+
+	/* the new station is at the origin like station 0 */
+	if (add_station(&ctx, addr) != 3)
+		return -1;
+	if (ctx.snr_matrix[3 * 4 + 1] != snr10 ||
+	    ctx.snr_matrix[2 * 4 + 3] != snr20) {
+		fprintf(stderr, "%s: added station got %d and %d, not %d and %d\n",
+			__func__, ctx.snr_matrix[3 * 4 + 1],
+			ctx.snr_matrix[2 * 4 + 3], snr10, snr20);
+		ret = -1;
+	}
+
+	/* stations 0, 2 and the new one are left */
+	if (del_station_by_id(&ctx, 1))
+		return -1;
+	if (ctx.snr_matrix[0 * 3 + 1] != snr20 ||
+	    ctx.snr_matrix[2 * 3 + 1] != snr20) {
+		fprintf(stderr, "%s: SNR %d and %d after delete, not %d\n",
+			__func__, ctx.snr_matrix[0 * 3 + 1],
+			ctx.snr_matrix[2 * 3 + 1], snr20);
+		ret = -1;
+	}
+
+	/* the new station steps 10 m towards former station 2 */
+	ctx.sta_array[2]->dir_x = 10.0;
+	ctx.move_stations(&ctx);
+	if (ctx.snr_matrix[2 * 3 + 1] != snr10 ||
+	    ctx.snr_matrix[0 * 3 + 1] != snr20) {
+		fprintf(stderr, "%s: SNR %d and %d after move, not %d and %d\n",
+			__func__, ctx.snr_matrix[2 * 3 + 1],
+			ctx.snr_matrix[0 * 3 + 1], snr10, snr20);
+		ret = -1;
+	}
+
+	test_free(&ctx);
+	return ret;
+}
+
+/*
+ * The fading of a link stays with its stations when a station before them
+ * is removed and they move down by one index.
+ */
+static int test_fading_del_station(void)
+{
+	struct wmediumd ctx;
+	struct rng_stream rng;
+	int before, after, ret = 0;
+
+	test_init(&ctx, 4, false);
+	ctx.snr_matrix = calloc(4 * 4, sizeof(int));
+	/* the gains hardly change within the coherence time */
+	if (correlated_fading_init(&ctx, FADING_RAYLEIGH, 1e12, 0.0))
+		return -1;
+
+	rng_stream_init(&rng, 1, 0, 1, 0);
+	ctx.get_fading_signal(&ctx, ctx.sta_array[0], ctx.sta_array[1], &rng);
+	rng_stream_init(&rng, 1, 2, 3, 0);
+	before = ctx.get_fading_signal(&ctx, ctx.sta_array[2],
+				       ctx.sta_array[3], &rng);
+
+	if (del_station_by_id(&ctx, 0))
+		return -1;
+	rng_stream_init(&rng, 1, 1, 2, 1);
+	after = ctx.get_fading_signal(&ctx, ctx.sta_array[1],
+				      ctx.sta_array[2], &rng);
+	if (after != before) {
+		fprintf(stderr, "%s: fading of %d dB became %d dB\n",
+			__func__, before, after);
+		ret = -1;
+	}
+
+	correlated_fading_free(&ctx);
+	test_free(&ctx);
+	free(ctx.snr_matrix);
+	return ret;
+}
+
+static const struct {
+	const char *name;
+	int (*fn)(void);
+} tests[] = {
+	{ "hidden station tail", test_hidden_station_tail },
+	{ "unknown channel", test_unknown_channel },
+	{ "path loss add and delete", test_path_loss_add_del },
+	{ "edca saturation", test_edca_saturation },
+	{ "edca broadcast collision", test_edca_broadcast_collision },
+	{ "fading after station removal", test_fading_del_station },
+};
+
+int main(int argc, char *argv[])
+{
+	int i, failed = 0;
+
+	for (i = 0; i < (int)(sizeof(tests) / sizeof(tests[0])); i++) {
+		if (tests[i].fn()) {
+			printf("FAIL %s\n", tests[i].name);
+			failed++;
+		} else {
+			printf("ok   %s\n", tests[i].name);
+		}
+	}
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,222 @@
+/*
+ * Interval tree of the transmissions on the air.
+ *
+ * The tree is a treap ordered by start time.  Every node also keeps the
+ * latest and the earliest end time of its subtree, the former to skip
+ * subtrees without overlaps, the latter to find ended transmissions.
+ */
+
+#include <stdlib.h>
+#include <errno.h>
+
+#include "airtime.h"
+
+struct airtime_node {
+	uint64_t start, end;
+	uint64_t max_end, min_end;	/* of the subtree */
+	uint32_t prio;
+	int sender;
+	struct airtime_node *left, *right;
+};
+
+struct airtime {
+	struct airtime_node *root;
+	uint32_t prio_state;
+};
+
+/* xorshift32, the priorities only need to look random to the tree */
+static uint32_t next_prio(struct airtime *air)
+{
+	uint32_t x = air->prio_state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	air->prio_state = x;
+	return x;
+}
+
+static void update(struct airtime_node *n)
+{
+	n->max_end = n->end;
+	n->min_end = n->end;
+	if (n->left) {
+		if (n->left->max_end > n->max_end)
+			n->max_end = n->left->max_end;
+		if (n->left->min_end < n->min_end)
+			n->min_end = n->left->min_end;
+	}
+	if (n->right) {
+		if (n->right->max_end > n->max_end)
+			n->max_end = n->right->max_end;
+		if (n->right->min_end < n->min_end)
+			n->min_end = n->right->min_end;
+	}
+}
+
+static struct airtime_node *insert(struct airtime_node *root,
+				   struct airtime_node *n)
+{
+	struct airtime_node *child;
+
+	if (!root)
+		return n;
+
+	if (n->start < root->start) {
+		root->left = insert(root->left, n);
+		if (root->left->prio > root->prio) {
+			child = root->left;
+			root->left = child->right;
+			update(root);
+			child->right = root;
+			root = child;
+		}
+	} else {
+		root->right = insert(root->right, n);
+		if (root->right->prio > root->prio) {
+			child = root->right;
+			root->right = child->left;
+			update(root);
+			child->left = root;
+			root = child;
+		}
+	}
+	update(root);
+	return root;
+}
+
+/* join two trees, every start in a is at most every start in b */
+static struct airtime_node *merge(struct airtime_node *a,
+				  struct airtime_node *b)
+{
+	if (!a)
+		return b;
+	if (!b)
+		return a;
+
+	if (a->prio > b->prio) {
+		a->right = merge(a->right, b);
+		update(a);
+		return a;
+	}
+	b->left = merge(a, b->left);
+	update(b);
+	return b;
+}
+
+static void overlaps(struct airtime_node *n, uint64_t start, uint64_t end,
+		     airtime_fn fn, void *arg)
+{
+	while (n && n->max_end > start) {
+		overlaps(n->left, start, end, fn, arg);
+		if (n->start >= end)
+			return;
+		if (n->end > start)
+			fn(arg, n->sender);
+		n = n->right;
+	}
+}
+
+static struct airtime_node *prune(struct airtime_node *n, uint64_t before)
+{
+	struct airtime_node *joined;
+
+	if (!n || n->min_end > before)
+		return n;
+
+	n->left = prune(n->left, before);
+	n->right = prune(n->right, before);
+	if (n->end > before) {
+		update(n);
+		return n;
+	}
+
+	joined = merge(n->left, n->right);
+	free(n);
+	return joined;
+}
+
+static struct airtime_node *remove_sender(struct airtime_node *n,
+					  int sender)
+{
+	struct airtime_node *joined;
+
+	if (!n)
+		return NULL;
+
+	n->left = remove_sender(n->left, sender);
+	n->right = remove_sender(n->right, sender);
+	if (n->sender != sender) {
+		if (n->sender > sender)
+			n->sender--;
+		update(n);
+		return n;
+	}
+
+	joined = merge(n->left, n->right);
+	free(n);
+	return joined;
+}
+
+static void free_nodes(struct airtime_node *n)
+{
+	if (!n)
+		return;
+	free_nodes(n->left);
+	free_nodes(n->right);
+	free(n);
+}
+
+struct airtime *airtime_create(void)
+{
+	struct airtime *air;
+
+	air = calloc(1, sizeof(*air));
+	if (!air)
+		return NULL;
+	air->prio_state = 2463534242u;
+	return air;
+}
+
+void airtime_free(struct airtime *air)
+{
+	if (!air)
+		return;
+	free_nodes(air->root);
+	free(air);
+}
+
+int airtime_insert(struct airtime *air, uint64_t start, uint64_t end,
+		   int sender)
+{
+	struct airtime_node *n;
+
+	n = calloc(1, sizeof(*n));
+	if (!n)
+		return -ENOMEM;
+
+	n->start = start;
+	n->end = end;
+	n->max_end = end;
+	n->min_end = end;
+	n->sender = sender;
+	n->prio = next_prio(air);
+	air->root = insert(air->root, n);
+	return 0;
+}
+
+void airtime_overlaps(struct airtime *air, uint64_t start, uint64_t end,
+		      airtime_fn fn, void *arg)
+{
+	overlaps(air->root, start, end, fn, arg);
+}
+
+void airtime_prune(struct airtime *air, uint64_t before)
+{
+	air->root = prune(air->root, before);
+}
+
+void airtime_remove_sender(struct airtime *air, int sender)
+{
+	air->root = remove_sender(air->root, sender);
+}
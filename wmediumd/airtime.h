@@ -0,0 +1,69 @@
+/*
+ * Interval tree of the transmissions on the air.
+ */
+
+#ifndef WMEDIUMD_AIRTIME_H
+#define WMEDIUMD_AIRTIME_H
+
+#include <stdint.h>
+
+struct airtime;
+
+/**
+ * Function called for every transmission overlapping a query
+ * @param arg The argument passed to airtime_overlaps()
+ * @param sender The index of the sending station
+ */
+typedef void (*airtime_fn)(void *arg, int sender);
+
+/**
+ * Create an empty tree
+ * @return The tree or NULL on error
+ */
+struct airtime *airtime_create(void);
+
+/**
+ * Free a tree and all transmissions in it
+ * @param air The tree
+ */
+void airtime_free(struct airtime *air);
+
+/**
+ * Add a transmission
+ * @param air The tree
+ * @param start The time the transmission starts [usec]
+ * @param end The time the transmission ends [usec]
+ * @param sender The index of the sending station
+ * @return 0 on success, -ENOMEM on error
+ */
+int airtime_insert(struct airtime *air, uint64_t start, uint64_t end,
+		   int sender);
+
+/**
+ * Call a function for every transmission overlapping [start, end), in
+ * O(min(n, k log n)) for k overlapping transmissions
+ * @param air The tree
+ * @param start The start of the query interval [usec]
+ * @param end The end of the query interval [usec]
+ * @param fn The function
+ * @param arg The argument for fn
+ */
+void airtime_overlaps(struct airtime *air, uint64_t start, uint64_t end,
+		      airtime_fn fn, void *arg);
+
+/**
+ * Remove every transmission that ended at or before a time
+ * @param air The tree
+ * @param before The time [usec]
+ */
+void airtime_prune(struct airtime *air, uint64_t before);
+
+/**
+ * Remove every transmission of a station, the stations following it
+ * move down by one index
+ * @param air The tree
+ * @param sender The index of the removed station
+ */
+void airtime_remove_sender(struct airtime *air, int sender);
+
+#endif //WMEDIUMD_AIRTIME_H
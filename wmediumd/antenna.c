@@ -0,0 +1,127 @@
+/*
+ * Directional antenna gain patterns.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#include "antenna.h"
+
+struct pattern_point {
+	double angle;	/* [0, 2 * M_PI) */
+	double gain;
+};
+
+static int compare_angle(const void *a, const void *b)
+{
+	const struct pattern_point *pa = a, *pb = b;
+
+	return (pa->angle > pb->angle) - (pa->angle < pb->angle);
+}
+
+/* Direction at the center of a table entry */
+static double entry_angle(int idx)
+{
+	double p = (idx + 0.5) * 4.0 / ANTENNA_TABLE_SIZE;
+	double angle;
+
+	if (p < 1.0)
+		angle = atan2(p, 1.0 - p);
+	else if (p < 2.0)
+		angle = atan2(2.0 - p, 1.0 - p);
+	else if (p < 3.0)
+		angle = atan2(2.0 - p, p - 3.0);
+	else
+		angle = atan2(p - 4.0, p - 3.0);
+
+	return angle < 0.0 ? angle + 2.0 * M_PI : angle;
+}
+
+/* Interpolate the gain at an angle between the sorted points, cyclically */
+static double interpolate(const struct pattern_point *points, int num,
+			  double angle)
+{
+	const struct pattern_point *lo, *hi;
+	double span, offset;
+	int i;
+
+	for (i = 0; i < num && points[i].angle <= angle; i++)
+		;
+	lo = &points[(i + num - 1) % num];
+	hi = &points[i % num];
+
+	span = hi->angle - lo->angle;
+	offset = angle - lo->angle;
+	if (span <= 0.0)
+		span += 2.0 * M_PI;
+	if (offset < 0.0)
+		offset += 2.0 * M_PI;
+	if (span <= 0.0 || span >= 2.0 * M_PI)
+		return lo->gain;
+
+	return lo->gain + (hi->gain - lo->gain) * offset / span;
+}
+
+int read_antenna_pattern(struct wmediumd *ctx, struct antenna_pattern *pattern,
+			 const char *file_name)
+{
+	struct pattern_point *points = NULL, *tmp;
+	double angle, gain;
+	char *line = NULL;
+	size_t n = 0;
+	int num = 0, size = 0, i, ret = 0;
+	FILE *fp;
+
+	fp = fopen(file_name, "r");
+	if (fp == NULL) {
+		w_flogf(ctx, LOG_ERR, stderr,
+			"fopen failed %s\n", strerror(errno));
+		return -errno;
+	}
+
+	while (getline(&line, &n, fp) >= 0) {
+		if (line[strspn(line, " \t")] == '#' ||
+		    sscanf(line, "%lf %lf", &angle, &gain) != 2)
+			continue;
+
+		if (num == size) {
+			size = size ? size * 2 : 64;
+			tmp = realloc(points, size * sizeof(*points));
+			if (!tmp) {
+				w_flogf(ctx, LOG_ERR, stderr,
+					"Out of memory(antenna pattern)\n");
+				ret = -ENOMEM;
+				goto out;
+			}
+			points = tmp;
+		}
+
+		angle = fmod(angle * M_PI / 180.0, 2.0 * M_PI);
+		points[num].angle = angle < 0.0 ? angle + 2.0 * M_PI : angle;
+		points[num].gain = gain;
+		num++;
+	}
+
+	if (!num) {
+		w_flogf(ctx, LOG_ERR, stderr,
+			"No gains found in %s\n", file_name);
+		ret = -EINVAL;
+		goto out;
+	}
+	qsort(points, num, sizeof(*points), compare_angle);
+
+	pattern->max_gain = -INFINITY;
+	for (i = 0; i < ANTENNA_TABLE_SIZE; i++) {
+		pattern->gain[i] = interpolate(points, num, entry_angle(i));
+		if (pattern->gain[i] > pattern->max_gain)
+			pattern->max_gain = pattern->gain[i];
+	}
+
+out:
+	free(line);
+	free(points);
+	fclose(fp);
+	return ret;
+}
@@ -0,0 +1,43 @@
+/*
+ * Directional antenna gain patterns.
+ */
+
+#ifndef WMEDIUMD_ANTENNA_H
+#define WMEDIUMD_ANTENNA_H
+
+#include "wmediumd.h"
+
+/* entries of a sampled pattern, a power of two */
+#define ANTENNA_TABLE_SIZE	(2048)
+
+/*
+ * Gain over the horizontal plane, sampled at pseudo-angles instead of
+ * angles: the direction (x, y) is indexed by where it meets the diamond
+ * |x| + |y| = 1, counterclockwise from the boresight along x.  The
+ * pseudo-angle grows with the angle and needs one division instead of
+ * an atan2(); the table is built with atan2() once.  With the table size
+ * an entry spans at most 0.2 degree.
+ */
+struct antenna_pattern {
+	char *name;
+	float gain[ANTENNA_TABLE_SIZE];	/* [dBi] */
+	float max_gain;			/* [dBi] */
+};
+
+struct station_antenna {
+	const struct antenna_pattern *pattern;	/* NULL if isotropic */
+	float cos, sin;				/* of the orientation */
+};
+
+/**
+ * Read a gain pattern of "angle gain" lines, angles counterclockwise from
+ * the boresight [degree] and gains [dBi], interpolated linearly in between
+ * @param ctx The wmediumd context
+ * @param pattern The pattern to fill
+ * @param file_name The pattern file
+ * @return 0 on success otherwise a negative errno value
+ */
+int read_antenna_pattern(struct wmediumd *ctx, struct antenna_pattern *pattern,
+			 const char *file_name);
+
+#endif //WMEDIUMD_ANTENNA_H
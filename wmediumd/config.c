@@ -29,6 +29,12 @@
 #include <math.h>
 
 #include "wmediumd.h"
+#include "fading.h"
+#include "path_loss.h"
+#include "mobility_trace.h"
+#include "obstacles.h"
+#include "antenna.h"
+#include "airtime.h"
 
 static void string_to_mac_address(const char *str, u8 *addr)
 {
@@ -81,84 +87,241 @@ int use_fixed_random_value(struct wmediumd *ctx)
 	return ctx->error_prob_matrix != NULL || ctx->station_err_matrix != NULL;
 }
 
-#define FREQ_1CH (2.412e9)		// [Hz]
-#define SPEED_LIGHT (2.99792458e8)	// [meter/sec]
-/*
- * Calculate path loss based on a log distance model
- *
- * This function returns path loss [dBm].
- */
-static int calc_path_loss_log_distance(void *model_param,
-			  struct station *dst, struct station *src)
+static void move_stations_donothing(struct wmediumd *ctx)
 {
-	struct log_distance_model_param *param;
-	double PL, PL0, d;
-
-	param = model_param;
-
-	d = sqrt((src->x - dst->x) * (src->x - dst->x) +
-		 (src->y - dst->y) * (src->y - dst->y));
-
-	/*
-	 * Calculate PL0 with Free-space path loss in decibels
-	 *
-	 * 20 * log10 * (4 * M_PI * d * f / c)
-	 *   d: distance [meter]
-	 *   f: frequency [Hz]
-	 *   c: speed of light in a vacuum [meter/second]
-	 *
-	 * https://en.wikipedia.org/wiki/Free-space_path_loss
-	 */
-	PL0 = 20.0 * log10(4.0 * M_PI * 1.0 * FREQ_1CH / SPEED_LIGHT);
-
-	/*
-	 * Calculate signal strength with Log-distance path loss model
-	 * https://en.wikipedia.org/wiki/Log-distance_path_loss_model
-	 */
-	PL = PL0 + 10.0 * param->path_loss_exponent * log10(d) + param->Xg;
-
-	return PL;
 }
 
-static void recalc_path_loss(struct wmediumd *ctx)
+/*
+ * Get the loss of an obstacle, given either directly or by the name of one
+ * of the materials
+ */
+static int parse_obstacle_loss(struct wmediumd *ctx,
+			       const config_setting_t *materials,
+			       const config_setting_t *setting, float *loss)
 {
-	int start, end, path_loss;
+	const config_setting_t *material;
+	const char *name, *material_name;
+	double value;
+	int i;
+
+	if (config_setting_lookup_float(setting, "loss", &value) ==
+	    CONFIG_TRUE) {
+		*loss = value;
+		return 0;
+	}
 
-	for (start = 0; start < ctx->num_stas; start++) {
-		for (end = 0; end < ctx->num_stas; end++) {
-			if (start == end)
-				continue;
+	if (config_setting_lookup_string(setting, "material", &name) !=
+	    CONFIG_TRUE) {
+		w_flogf(ctx, LOG_ERR, stderr,
+			"Obstacle without material or loss\n");
+		return -EINVAL;
+	}
 
-			path_loss = ctx->calc_path_loss(ctx->path_loss_param,
-				ctx->sta_array[end], ctx->sta_array[start]);
-			ctx->snr_matrix[ctx->num_stas * start + end] =
-				ctx->sta_array[start]->tx_power - path_loss -
-				NOISE_LEVEL;
+	for (i = 0; i < config_setting_length(materials); i++) {
+		material = config_setting_get_elem(materials, i);
+		if (config_setting_lookup_string(material, "name",
+						 &material_name) !=
+		    CONFIG_TRUE ||
+		    config_setting_lookup_float(material, "loss", &value) !=
+		    CONFIG_TRUE) {
+			w_flogf(ctx, LOG_ERR, stderr,
+				"Invalid material: expected { name, loss }\n");
+			return -EINVAL;
+		}
+		if (strcmp(material_name, name) == 0) {
+			*loss = value;
+			return 0;
 		}
 	}
+
+	w_flogf(ctx, LOG_ERR, stderr, "Unknown material %s\n", name);
+	return -EINVAL;
 }
 
-static void move_stations_to_direction(struct wmediumd *ctx)
+static int parse_corners(struct wmediumd *ctx,
+			 const config_setting_t *setting, double *from,
+			 double *to)
 {
-	struct station *station;
-	struct timespec now;
+	const config_setting_t *a, *b;
+
+	a = config_setting_get_member(setting, "from");
+	b = config_setting_get_member(setting, "to");
+	if (!a || !b || config_setting_length(a) != 2 ||
+	    config_setting_length(b) != 2) {
+		w_flogf(ctx, LOG_ERR, stderr,
+			"Invalid obstacle: expected from = (double,double) and to = (double,double)\n");
+		return -EINVAL;
+	}
 
-	clock_gettime(CLOCK_MONOTONIC, &now);
-	if (!timespec_before(&ctx->next_move, &now))
-		return;
+	from[0] = config_setting_get_float_elem(a, 0);
+	from[1] = config_setting_get_float_elem(a, 1);
+	to[0] = config_setting_get_float_elem(b, 0);
+	to[1] = config_setting_get_float_elem(b, 1);
+	return 0;
+}
 
-	list_for_each_entry(station, &ctx->stations, list) {
-		station->x += station->dir_x;
-		station->y += station->dir_y;
+/*
+ * Parse the walls and floors of the model.  A wall stands vertically
+ * between two points from its bottom to its top, a floor is a horizontal
+ * rectangle between two corners at a height.
+ */
+static int parse_obstacles(struct wmediumd *ctx, config_t *cf)
+{
+	const config_setting_t *materials, *walls, *floors, *setting;
+	struct obstacle *obstacle, *o;
+	double from[2], to[2], bottom, top, height;
+	int num_walls, num_floors, i, ret = -EINVAL;
+
+	materials = config_lookup(cf, "model.materials");
+	walls = config_lookup(cf, "model.walls");
+	floors = config_lookup(cf, "model.floors");
+	num_walls = walls ? config_setting_length(walls) : 0;
+	num_floors = floors ? config_setting_length(floors) : 0;
+	if (!num_walls && !num_floors)
+		return 0;
+
+	obstacle = calloc(num_walls + num_floors, sizeof(*obstacle));
+	if (!obstacle) {
+		w_flogf(ctx, LOG_ERR, stderr, "Out of memory(obstacles)\n");
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < num_walls; i++) {
+		setting = config_setting_get_elem(walls, i);
+		o = &obstacle[i];
+		if (parse_corners(ctx, setting, from, to) ||
+		    parse_obstacle_loss(ctx, materials, setting, &o->loss))
+			goto out;
+		if (config_setting_lookup_float(setting, "bottom", &bottom) !=
+		    CONFIG_TRUE ||
+		    config_setting_lookup_float(setting, "top", &top) !=
+		    CONFIG_TRUE || top < bottom) {
+			w_flogf(ctx, LOG_ERR, stderr,
+				"Invalid wall: expected bottom <= top\n");
+			goto out;
+		}
+		o->origin[0] = from[0];
+		o->origin[1] = from[1];
+		o->origin[2] = bottom;
+		o->u[0] = to[0] - from[0];
+		o->u[1] = to[1] - from[1];
+		o->v[2] = top - bottom;
+	}
+
+	for (i = 0; i < num_floors; i++) {
+		setting = config_setting_get_elem(floors, i);
+		o = &obstacle[num_walls + i];
+		if (parse_corners(ctx, setting, from, to) ||
+		    parse_obstacle_loss(ctx, materials, setting, &o->loss))
+			goto out;
+		if (config_setting_lookup_float(setting, "height", &height) !=
+		    CONFIG_TRUE) {
+			w_flogf(ctx, LOG_ERR, stderr,
+				"Invalid floor: expected height\n");
+			goto out;
+		}
+		o->origin[0] = from[0];
+		o->origin[1] = from[1];
+		o->origin[2] = height;
+		o->u[0] = to[0] - from[0];
+		o->v[1] = to[1] - from[1];
 	}
-	recalc_path_loss(ctx);
 
-	clock_gettime(CLOCK_MONOTONIC, &ctx->next_move);
-	ctx->next_move.tv_sec += MOVE_INTERVAL;
+	ctx->obstacles = obstacles_create(obstacle, num_walls + num_floors);
+	if (!ctx->obstacles) {
+		w_flogf(ctx, LOG_ERR, stderr, "Out of memory(obstacles)\n");
+		ret = -ENOMEM;
+		goto out;
+	}
+	w_logf(ctx, LOG_INFO, "%d walls and %d floors\n", num_walls,
+	       num_floors);
+	ret = 0;
+out:
+	free(obstacle);
+	return ret;
 }
 
-static void move_stations_donothing(struct wmediumd *ctx)
+/*
+ * Parse the antenna patterns and which station uses which of them at
+ * which orientation.  Stations named "isotropic" have no pattern.
+ */
+static int parse_antennas(struct wmediumd *ctx, config_t *cf)
 {
+	const config_setting_t *antennas, *antenna, *station_antennas;
+	const config_setting_t *orientations;
+	struct station_antenna *sta;
+	const char *name, *file;
+	double orientation;
+	int i, j;
+
+	station_antennas = config_lookup(cf, "model.station_antennas");
+	if (!station_antennas)
+		return 0;
+	if (config_setting_length(station_antennas) != ctx->num_stas) {
+		w_flogf(ctx, LOG_ERR, stderr,
+			"Specify %d station_antennas\n", ctx->num_stas);
+		return -EINVAL;
+	}
+	orientations = config_lookup(cf, "model.orientations");
+	if (orientations &&
+	    config_setting_length(orientations) != ctx->num_stas) {
+		w_flogf(ctx, LOG_ERR, stderr,
+			"Specify %d orientations\n", ctx->num_stas);
+		return -EINVAL;
+	}
+
+	antennas = config_lookup(cf, "model.antennas");
+	ctx->antenna_num = antennas ? config_setting_length(antennas) : 0;
+	ctx->antennas = calloc(ctx->antenna_num ? ctx->antenna_num : 1,
+			       sizeof(struct antenna_pattern));
+	ctx->sta_antennas = calloc(ctx->num_stas,
+				   sizeof(struct station_antenna));
+	if (!ctx->antennas || !ctx->sta_antennas) {
+		w_flogf(ctx, LOG_ERR, stderr, "Out of memory(antennas)\n");
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < ctx->antenna_num; i++) {
+		antenna = config_setting_get_elem(antennas, i);
+		if (config_setting_lookup_string(antenna, "name", &name) !=
+		    CONFIG_TRUE ||
+		    config_setting_lookup_string(antenna, "file", &file) !=
+		    CONFIG_TRUE) {
+			w_flogf(ctx, LOG_ERR, stderr,
+				"Invalid antenna: expected { name, file }\n");
+			return -EINVAL;
+		}
+		ctx->antennas[i].name = strdup(name);
+		if (!ctx->antennas[i].name)
+			return -ENOMEM;
+		if (read_antenna_pattern(ctx, &ctx->antennas[i], file))
+			return -EINVAL;
+	}
+
+	for (i = 0; i < ctx->num_stas; i++) {
+		sta = &ctx->sta_antennas[i];
+		name = config_setting_get_string_elem(station_antennas, i);
+		if (!name) {
+			w_flogf(ctx, LOG_ERR, stderr,
+				"Invalid station_antennas: expected strings\n");
+			return -EINVAL;
+		}
+		for (j = 0; j < ctx->antenna_num; j++)
+			if (strcmp(ctx->antennas[j].name, name) == 0)
+				sta->pattern = &ctx->antennas[j];
+		if (!sta->pattern && strcmp(name, "isotropic") != 0) {
+			w_flogf(ctx, LOG_ERR, stderr,
+				"Unknown antenna %s\n", name);
+			return -EINVAL;
+		}
+
+		orientation = orientations ?
+			config_setting_get_float_elem(orientations, i) : 0.0;
+		sta->cos = cos(orientation * M_PI / 180.0);
+		sta->sin = sin(orientation * M_PI / 180.0);
+	}
+
+	return 0;
 }
 
 static int parse_path_loss(struct wmediumd *ctx, config_t *cf)
@@ -166,8 +329,11 @@ static int parse_path_loss(struct wmediumd *ctx, config_t *cf)
 	struct station *station;
 	const config_setting_t *positions, *position;
 	const config_setting_t *directions, *direction;
-	const config_setting_t *tx_powers, *model;
+	const config_setting_t *tx_powers, *frequencies, *model;
 	const char *path_loss_model_name;
+	const char *mobility_trace = NULL;
+	int threads = 0, continuous = 0, kinetic = 0, background = 1, ret;
+	double range_margin, tolerance = MOBILITY_TOLERANCE;
 
 	positions = config_lookup(cf, "model.positions");
 	if (!positions) {
@@ -191,6 +357,14 @@ static int parse_path_loss(struct wmediumd *ctx, config_t *cf)
 		ctx->move_stations = move_stations_to_direction;
 	}
 
+	frequencies = config_lookup(cf, "model.frequencies");
+	if (frequencies &&
+	    config_setting_length(frequencies) != ctx->num_stas) {
+		w_flogf(ctx, LOG_ERR, stderr,
+			"Specify %d frequencies\n", ctx->num_stas);
+		return -EINVAL;
+	}
+
 	tx_powers = config_lookup(cf, "model.tx_powers");
 	if (!tx_powers) {
 		w_flogf(ctx, LOG_ERR, stderr,
@@ -214,6 +388,8 @@ static int parse_path_loss(struct wmediumd *ctx, config_t *cf)
 		struct log_distance_model_param *param;
 
 		ctx->calc_path_loss = calc_path_loss_log_distance;
+		ctx->calc_path_loss_row = calc_path_loss_row_log_distance;
+		ctx->calc_path_loss_range = calc_path_loss_range_log_distance;
 
 		param = malloc(sizeof(*param));
 		if (!param) {
@@ -234,6 +410,121 @@ static int parse_path_loss(struct wmediumd *ctx, config_t *cf)
 			w_flogf(ctx, LOG_ERR, stderr, "xg not found\n");
 			return -EINVAL;
 		}
+		param->PL0 = log_distance_reference_loss();
+		ctx->path_loss_param = param;
+	} else if (strcmp(path_loss_model_name, "free_space") == 0) {
+		struct log_distance_model_param *param;
+
+		ctx->calc_path_loss = calc_path_loss_log_distance;
+		ctx->calc_path_loss_row = calc_path_loss_row_log_distance;
+		ctx->calc_path_loss_range = calc_path_loss_range_log_distance;
+
+		param = malloc(sizeof(*param));
+		if (!param) {
+			w_flogf(ctx, LOG_ERR, stderr,
+				"Out of memory(path_loss_param)\n");
+			return -EINVAL;
+		}
+		param->path_loss_exponent = 2.0;
+		param->Xg = 0.0;
+		param->PL0 = log_distance_reference_loss();
+		ctx->path_loss_param = param;
+	} else if (strcmp(path_loss_model_name, "itu") == 0) {
+		struct log_distance_model_param *param;
+		int n_floors, power_loss_coefficient;
+		double floor_loss;
+
+		ctx->calc_path_loss = calc_path_loss_log_distance;
+		ctx->calc_path_loss_row = calc_path_loss_row_log_distance;
+		ctx->calc_path_loss_range = calc_path_loss_range_log_distance;
+
+		param = malloc(sizeof(*param));
+		if (!param) {
+			w_flogf(ctx, LOG_ERR, stderr,
+				"Out of memory(path_loss_param)\n");
+			return -EINVAL;
+		}
+
+		if (config_setting_lookup_int(model, "nFLOORS",
+			&n_floors) != CONFIG_TRUE ||
+		    config_setting_lookup_float(model, "LF",
+			&floor_loss) != CONFIG_TRUE ||
+		    config_setting_lookup_int(model, "pL",
+			&power_loss_coefficient) != CONFIG_TRUE) {
+			w_flogf(ctx, LOG_ERR, stderr,
+				"itu needs nFLOORS, LF and pL\n");
+			return -EINVAL;
+		}
+
+		/*
+		 * ITU-R P.1238 indoor model
+		 * 20 * log10(f) + N * log10(d) + Lf(n) - 28
+		 *   f: frequency [MHz]
+		 *   N: distance power loss coefficient
+		 *   Lf(n): floor penetration loss of n floors [dB]
+		 */
+		param->path_loss_exponent = power_loss_coefficient / 10.0;
+		param->Xg = floor_loss * n_floors;
+		param->PL0 = 20.0 * log10(FREQ_1CH / 1e6) - 28.0;
+		ctx->path_loss_param = param;
+	} else if (strcmp(path_loss_model_name, "two_ray_ground") == 0) {
+		struct two_ray_ground_model_param *param;
+
+		ctx->calc_path_loss = NULL;
+		ctx->calc_path_loss_row = calc_path_loss_row_two_ray_ground;
+		ctx->calc_path_loss_range = calc_path_loss_range_two_ray_ground;
+
+		param = malloc(sizeof(*param));
+		if (!param) {
+			w_flogf(ctx, LOG_ERR, stderr,
+				"Out of memory(path_loss_param)\n");
+			return -EINVAL;
+		}
+
+		if (config_setting_lookup_float(model, "antenna_height",
+			&param->antenna_height) != CONFIG_TRUE ||
+		    param->antenna_height <= 0.0) {
+			w_flogf(ctx, LOG_ERR, stderr,
+				"antenna_height must be positive\n");
+			return -EINVAL;
+		}
+		param->PL0 = log_distance_reference_loss();
+		ctx->path_loss_param = param;
+	} else if (strcmp(path_loss_model_name, "log_normal_shadowing") == 0) {
+		struct log_normal_shadowing_model_param *param;
+		double sigma;
+
+		ctx->calc_path_loss = NULL;
+		ctx->calc_path_loss_row =
+			calc_path_loss_row_log_normal_shadowing;
+		ctx->calc_path_loss_range =
+			calc_path_loss_range_log_normal_shadowing;
+
+		param = malloc(sizeof(*param));
+		if (!param) {
+			w_flogf(ctx, LOG_ERR, stderr,
+				"Out of memory(path_loss_param)\n");
+			return -EINVAL;
+		}
+
+		if (config_setting_lookup_float(model, "path_loss_exp",
+			&param->path_loss_exponent) != CONFIG_TRUE) {
+			w_flogf(ctx, LOG_ERR, stderr,
+				"path_loss_exponent not found\n");
+			return -EINVAL;
+		}
+		if (config_setting_lookup_float(model, "sigma",
+			&sigma) != CONFIG_TRUE || sigma < 0.0) {
+			w_flogf(ctx, LOG_ERR, stderr,
+				"sigma must not be negative\n");
+			return -EINVAL;
+		}
+		param->PL0 = log_distance_reference_loss();
+		if (init_log_normal_shadowing(param, sigma)) {
+			w_flogf(ctx, LOG_ERR, stderr,
+				"Out of memory(path_loss_param)\n");
+			return -ENOMEM;
+		}
 		ctx->path_loss_param = param;
 	} else {
 		w_flogf(ctx, LOG_ERR, stderr, "No path loss model found\n");
@@ -242,13 +533,16 @@ static int parse_path_loss(struct wmediumd *ctx, config_t *cf)
 
 	list_for_each_entry(station, &ctx->stations, list) {
 		position = config_setting_get_elem(positions, station->index);
-		if (config_setting_length(position) != 2) {
+		if (config_setting_length(position) != 2 &&
+		    config_setting_length(position) != 3) {
 			w_flogf(ctx, LOG_ERR, stderr,
-				"Invalid position: expected (double,double)\n");
+				"Invalid position: expected (double,double[,double])\n");
 			return -EINVAL;
 		}
 		station->x = config_setting_get_float_elem(position, 0);
 		station->y = config_setting_get_float_elem(position, 1);
+		station->z = config_setting_length(position) == 3 ?
+			config_setting_get_float_elem(position, 2) : 0.0;
 
 		if (directions) {
 			direction = config_setting_get_elem(directions,
@@ -266,34 +560,388 @@ static int parse_path_loss(struct wmediumd *ctx, config_t *cf)
 
 		station->tx_power = config_setting_get_float_elem(
 			tx_powers, station->index);
+
+		station->freq = frequencies ? config_setting_get_int_elem(
+			frequencies, station->index) : FREQ_UNKNOWN;
+		if (frequencies && station->freq <= 0) {
+			w_flogf(ctx, LOG_ERR, stderr,
+				"Invalid frequency: expected MHz\n");
+			return -EINVAL;
+		}
+	}
+
+	if (config_lookup_int(cf, "model.path_loss_threads", &threads) ==
+	    CONFIG_TRUE && threads < 0) {
+		w_flogf(ctx, LOG_ERR, stderr,
+			"path_loss_threads must not be negative\n");
+		return -EINVAL;
+	}
+
+	range_margin = PATH_LOSS_RANGE_MARGIN + 4 * ctx->fading_coefficient;
+	if (config_lookup_float(cf, "model.range_margin", &range_margin) ==
+	    CONFIG_TRUE && range_margin < 0.0) {
+		w_flogf(ctx, LOG_ERR, stderr,
+			"range_margin must not be negative\n");
+		return -EINVAL;
 	}
 
-	recalc_path_loss(ctx);
+	ret = parse_obstacles(ctx, cf);
+	if (ret)
+		return ret;
+	ret = parse_antennas(ctx, cf);
+	if (ret)
+		return ret;
+
+	if (init_path_loss(ctx, threads, range_margin)) {
+		w_flogf(ctx, LOG_ERR, stderr,
+			"Out of memory(path_loss)\n");
+		return -ENOMEM;
+	}
+	ctx->get_reachable_stations = get_reachable_stations_grid;
+
+	config_lookup_bool(cf, "model.continuous_mobility", &continuous);
+	config_lookup_bool(cf, "model.kinetic_mobility", &kinetic);
+	if (kinetic)
+		continuous = 1;
+	if (config_lookup_string(cf, "model.mobility_trace",
+				 &mobility_trace) == CONFIG_TRUE) {
+		if (directions) {
+			w_flogf(ctx, LOG_ERR, stderr,
+				"directions and mobility_trace could not be used at the same time\n");
+			return -EINVAL;
+		}
+		continuous = 1;
+	}
+
+	if (continuous) {
+		if (ctx->obstacles || ctx->sta_antennas) {
+			w_flogf(ctx, LOG_ERR, stderr,
+				"obstacles and antennas could not be used with continuous_mobility\n");
+			return -EINVAL;
+		}
+		if (!directions && !mobility_trace) {
+			w_flogf(ctx, LOG_ERR, stderr,
+				"continuous_mobility requires directions\n");
+			return -EINVAL;
+		}
+		if (config_lookup_float(cf, "model.mobility_tolerance",
+					&tolerance) == CONFIG_TRUE &&
+		    tolerance <= 0.0) {
+			w_flogf(ctx, LOG_ERR, stderr,
+				"mobility_tolerance must be positive\n");
+			return -EINVAL;
+		}
+		if (init_continuous_mobility(ctx, tolerance)) {
+			w_flogf(ctx, LOG_ERR, stderr,
+				"Out of memory(continuous_mobility)\n");
+			return -ENOMEM;
+		}
+		if (kinetic && init_kinetic_mobility(ctx)) {
+			w_flogf(ctx, LOG_ERR, stderr,
+				"Out of memory(kinetic_mobility)\n");
+			return -ENOMEM;
+		}
+	}
+
+	if (mobility_trace && init_mobility_trace(ctx, mobility_trace))
+		return -EINVAL;
+
+	config_lookup_bool(cf, "model.mobility_thread", &background);
+	if (directions && !continuous && background &&
+	    init_mobility_thread(ctx)) {
+		w_flogf(ctx, LOG_ERR, stderr,
+			"Cannot start the mobility thread\n");
+		return -EINVAL;
+	}
 
 	return 0;
 }
 
-static double pseudo_normal_distribution(void)
+static int find_per_class(struct wmediumd *ctx, const char *name)
 {
 	int i;
-	double normal = -6.0;
 
-	for (i = 0; i < 12; i++)
-		normal += drand48();
+	for (i = 0; i < ctx->per_class_num; i++) {
+		if (ctx->per_classes[i].name &&
+		    strcmp(ctx->per_classes[i].name, name) == 0)
+			return i;
+	}
+	return -1;
+}
+
+static int parse_per_classes(struct wmediumd *ctx, config_t *cf)
+{
+	const config_setting_t *classes, *cls, *class_links, *link;
+	const char *name, *file, *default_name;
+	int i, start, end, cls_idx;
+
+	classes = config_lookup(cf, "model.per_classes");
+	if (config_setting_length(classes) > PER_CLASS_MAX - 1) {
+		w_flogf(ctx, LOG_ERR, stderr,
+			"At most %d per_classes are supported\n",
+			PER_CLASS_MAX - 1);
+		return -EINVAL;
+	}
+
+	ctx->per_class_num = config_setting_length(classes);
+	ctx->per_classes = calloc(ctx->per_class_num,
+				  sizeof(struct per_class));
+	if (!ctx->per_classes) {
+		w_flogf(ctx, LOG_ERR, stderr, "Out of memory(per_classes)\n");
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < ctx->per_class_num; i++) {
+		cls = config_setting_get_elem(classes, i);
+		if (config_setting_lookup_string(cls, "name", &name) !=
+		    CONFIG_TRUE ||
+		    config_setting_lookup_string(cls, "file", &file) !=
+		    CONFIG_TRUE) {
+			w_flogf(ctx, LOG_ERR, stderr,
+				"Invalid per_class: expected { name, file }\n");
+			return -EINVAL;
+		}
+		if (find_per_class(ctx, name) >= 0) {
+			w_flogf(ctx, LOG_ERR, stderr,
+				"Duplicate per_class %s\n", name);
+			return -EINVAL;
+		}
+		if (read_per_class_file(ctx, &ctx->per_classes[i], file))
+			return -EINVAL;
+		ctx->per_classes[i].name = strdup(name);
+
+		w_logf(ctx, LOG_NOTICE, "Added PER class %d: %s (%s)\n",
+		       i, name, file);
+	}
+
+	ctx->per_class_default = PER_CLASS_NONE;
+	if (config_lookup_string(cf, "model.per_class_default",
+				 &default_name) == CONFIG_TRUE) {
+		cls_idx = find_per_class(ctx, default_name);
+		if (cls_idx < 0) {
+			w_flogf(ctx, LOG_ERR, stderr,
+				"Unknown per_class_default %s\n", default_name);
+			return -EINVAL;
+		}
+		ctx->per_class_default = cls_idx;
+	}
+
+	ctx->per_class_matrix = malloc(ctx->num_stas * ctx->num_stas);
+	if (!ctx->per_class_matrix) {
+		w_flogf(ctx, LOG_ERR, stderr,
+			"Out of memory(per_class_matrix)\n");
+		return -ENOMEM;
+	}
+	memset(ctx->per_class_matrix, ctx->per_class_default,
+	       ctx->num_stas * ctx->num_stas);
+
+	class_links = config_lookup(cf, "model.per_class_links");
+	for (i = 0; class_links && i < config_setting_length(class_links);
+	     i++) {
+		link = config_setting_get_elem(class_links, i);
+		if (config_setting_length(link) != 3) {
+			w_flogf(ctx, LOG_ERR, stderr,
+				"Invalid per_class_link: expected (int,int,string)\n");
+			return -EINVAL;
+		}
+		start = config_setting_get_int_elem(link, 0);
+		end = config_setting_get_int_elem(link, 1);
+		name = config_setting_get_string_elem(link, 2);
+
+		cls_idx = name ? find_per_class(ctx, name) : -1;
+		if (start < 0 || start >= ctx->num_stas ||
+		    end < 0 || end >= ctx->num_stas || cls_idx < 0) {
+			w_flogf(ctx, LOG_ERR, stderr,
+				"Invalid per_class_link [%d,%d,%s]\n",
+				start, end, name ? name : "?");
+			return -EINVAL;
+		}
+		ctx->per_class_matrix[ctx->num_stas * start + end] = cls_idx;
+		ctx->per_class_matrix[ctx->num_stas * end + start] = cls_idx;
+	}
+
+	ctx->get_error_prob = get_error_prob_from_per_class;
 
-	return normal;
+	return 0;
 }
 
-static int _get_fading_signal(struct wmediumd *ctx)
+static int _get_fading_signal(struct wmediumd *ctx, struct station *src,
+			      struct station *dst, struct rng_stream *rng)
 {
-	return ctx->fading_coefficient * pseudo_normal_distribution();
+	return ctx->fading_coefficient * rng_stream_normal(rng);
 }
 
-static int get_no_fading_signal(struct wmediumd *ctx)
+static int get_no_fading_signal(struct wmediumd *ctx, struct station *src,
+				struct station *dst, struct rng_stream *rng)
 {
 	return 0;
 }
 
+/*
+ * Coherence time [usec] from Clarke's approximation T_c = 0.423 / f_d
+ */
+static double doppler_to_coherence_time(double doppler)
+{
+	return 0.423 / doppler * 1000000.0;
+}
+
+static int parse_fading(struct wmediumd *ctx, config_t *cf)
+{
+	const config_setting_t *fading_coefficient;
+	const char *fading_model = "gaussian";
+	enum fading_model_type type;
+	double coherence_time, doppler, k_factor = 0.0;
+
+	ctx->get_fading_signal = get_no_fading_signal;
+	ctx->fading_coefficient = 0;
+	ctx->fading_param = NULL;
+
+	config_lookup_string(cf, "model.fading_model", &fading_model);
+
+	if (strcmp(fading_model, "gaussian") == 0) {
+		fading_coefficient =
+			config_lookup(cf, "model.fading_coefficient");
+		if (fading_coefficient &&
+		    config_setting_get_int(fading_coefficient) > 0) {
+			ctx->get_fading_signal = _get_fading_signal;
+			ctx->fading_coefficient =
+				config_setting_get_int(fading_coefficient);
+		}
+		return 0;
+	} else if (strcmp(fading_model, "rayleigh") == 0) {
+		type = FADING_RAYLEIGH;
+	} else if (strcmp(fading_model, "rician") == 0) {
+		type = FADING_RICIAN;
+		if (config_lookup_float(cf, "model.fading_k_factor",
+					&k_factor) != CONFIG_TRUE) {
+			w_flogf(ctx, LOG_ERR, stderr,
+				"fading_k_factor not found\n");
+			return -EINVAL;
+		}
+	} else {
+		w_flogf(ctx, LOG_ERR, stderr, "Unknown fading_model %s\n",
+			fading_model);
+		return -EINVAL;
+	}
+
+	if (config_lookup_float(cf, "model.fading_coherence_time",
+				&coherence_time) == CONFIG_TRUE) {
+		/* configured in msec */
+		coherence_time *= 1000.0;
+	} else if (config_lookup_float(cf, "model.fading_doppler",
+				       &doppler) == CONFIG_TRUE &&
+		   doppler > 0.0) {
+		coherence_time = doppler_to_coherence_time(doppler);
+	} else {
+		w_flogf(ctx, LOG_ERR, stderr,
+			"Specify fading_doppler or fading_coherence_time\n");
+		return -EINVAL;
+	}
+	if (coherence_time <= 0.0) {
+		w_flogf(ctx, LOG_ERR, stderr,
+			"fading_coherence_time should be positive\n");
+		return -EINVAL;
+	}
+
+	if (correlated_fading_init(ctx, type, coherence_time, k_factor)) {
+		w_flogf(ctx, LOG_ERR, stderr, "Out of memory(fading)\n");
+		return -ENOMEM;
+	}
+
+	w_logf(ctx, LOG_NOTICE, "Using %s fading, coherence time %.0f usec\n",
+	       fading_model, coherence_time);
+	return 0;
+}
+
+/*
+ * Interference is either estimated from the airtime of every station in
+ * the last window ("window") or computed from the transmissions that
+ * overlap each frame ("overlap").
+ */
+static int parse_interference(struct wmediumd *ctx, config_t *cf)
+{
+	const config_setting_t *enable_interference;
+	const char *interference_model = "window";
+	int i;
+
+	ctx->intf = NULL;
+	ctx->intf_active = NULL;
+	ctx->intf_num_active = 0;
+	ctx->intf_dirty = NULL;
+	ctx->intf_num_dirty = 0;
+	ctx->airtime = NULL;
+
+	enable_interference = config_lookup(cf, "ifaces.enable_interference");
+	if (!enable_interference ||
+	    !config_setting_get_bool(enable_interference))
+		return 0;
+
+	config_lookup_string(cf, "ifaces.interference_model",
+			     &interference_model);
+
+	if (strcmp(interference_model, "overlap") == 0) {
+		ctx->airtime = airtime_create();
+		if (!ctx->airtime) {
+			w_flogf(ctx, LOG_ERR, stderr, "Out of memory(airtime)\n");
+			return -ENOMEM;
+		}
+		return 0;
+	} else if (strcmp(interference_model, "window") != 0) {
+		w_flogf(ctx, LOG_ERR, stderr, "Unknown interference_model %s\n",
+			interference_model);
+		return -EINVAL;
+	}
+
+	ctx->intf = calloc(ctx->num_stas, sizeof(struct intf_info));
+	ctx->intf_active = calloc(ctx->num_stas, sizeof(int));
+	ctx->intf_dirty = calloc(ctx->num_stas, sizeof(int));
+	if (!ctx->intf || !ctx->intf_active || !ctx->intf_dirty) {
+		w_flogf(ctx, LOG_ERR, stderr, "Out of memory(intf)\n");
+		return -ENOMEM;
+	}
+	for (i = 0; i < ctx->num_stas; i++)
+		ctx->intf[i].signal = -200;
+
+	ctx->intf_window = INTF_WINDOW_DEFAULT;
+	if (config_lookup_int(cf, "ifaces.interference_window",
+			      &ctx->intf_window) == CONFIG_TRUE &&
+	    ctx->intf_window <= 0) {
+		w_flogf(ctx, LOG_ERR, stderr,
+			"interference_window must be positive\n");
+		return -EINVAL;
+	}
+	return 0;
+}
+
+/*
+ * Frames either queue behind each other with an estimated backoff, or
+ * contend slot by slot with the edca engine ("edca").  Either way, QoS
+ * data frames for the same receiver and TID may go out as one A-MPDU.
+ */
+static int parse_contention(struct wmediumd *ctx, config_t *cf)
+{
+	const char *contention = "serial";
+	int aggregation = 0;
+
+	ctx->edca_contention = false;
+	ctx->media = NULL;
+	ctx->num_media = 0;
+
+	config_lookup_bool(cf, "ifaces.aggregation", &aggregation);
+	ctx->aggregation = aggregation;
+
+	config_lookup_string(cf, "ifaces.contention", &contention);
+
+	if (strcmp(contention, "edca") == 0) {
+		ctx->edca_contention = true;
+	} else if (strcmp(contention, "serial") != 0) {
+		w_flogf(ctx, LOG_ERR, stderr, "Unknown contention %s\n",
+			contention);
+		return -EINVAL;
+	}
+	return 0;
+}
+
 /*
  *	Loads a config file into memory
  */
@@ -302,9 +950,9 @@ int load_config(struct wmediumd *ctx, const char *file, const char *per_file, bo
 	config_t cfg, *cf;
 	const config_setting_t *ids, *links, *model_type;
 	const config_setting_t *error_probs = NULL, *error_prob;
-	const config_setting_t *enable_interference;
-	const config_setting_t *fading_coefficient, *default_prob;
-	int count_ids, i, j;
+	const config_setting_t *default_prob;
+	const config_setting_t *per_classes;
+	int count_ids, i;
 	int start, end, snr;
 	struct station *station;
 	const char *model_type_str;
@@ -314,12 +962,35 @@ int load_config(struct wmediumd *ctx, const char *file, const char *per_file, bo
 		ctx->sta_array = malloc(0);
 		ctx->num_stas = 0;
 		ctx->intf = NULL;
+		ctx->intf_active = NULL;
+		ctx->intf_num_active = 0;
+		ctx->intf_dirty = NULL;
+		ctx->intf_num_dirty = 0;
+		ctx->airtime = NULL;
+		ctx->edca_contention = false;
+		ctx->aggregation = false;
+		ctx->media = NULL;
+		ctx->num_media = 0;
+		ctx->link_epoch = 1;
 		ctx->get_fading_signal = get_no_fading_signal;
 		ctx->fading_coefficient = 0;
+		ctx->fading_param = NULL;
 		ctx->move_stations = move_stations_donothing;
 		ctx->snr_matrix = malloc(0);
+		ctx->snr_matrix_back = NULL;
+		ctx->path_loss_state = NULL;
+		ctx->get_reachable_stations = NULL;
+		ctx->mobility_trace = NULL;
+		ctx->obstacles = NULL;
+		ctx->antennas = NULL;
+		ctx->antenna_num = 0;
+		ctx->sta_antennas = NULL;
 		ctx->per_matrix = NULL;
 		ctx->per_matrix_row_num = 0;
+		ctx->per_classes = NULL;
+		ctx->per_class_num = 0;
+		ctx->per_class_matrix = NULL;
+		ctx->per_class_default = PER_CLASS_NONE;
 		ctx->error_prob_matrix = NULL;
 		ctx->get_link_snr = get_link_snr_default;
 		ctx->get_error_prob = get_error_prob_from_specific_matrix;
@@ -371,6 +1042,12 @@ int load_config(struct wmediumd *ctx, const char *file, const char *per_file, bo
 		memcpy(station->addr, addr, ETH_ALEN);
 		memcpy(station->hwaddr, addr, ETH_ALEN);
 		station->tx_power = SNR_DEFAULT;
+		station->freq = FREQ_UNKNOWN;
+		station->tx_seq = 0;
+		station->cca_neighbors = NULL;
+		station->cca_num = 0;
+		station->cca_epoch = 0;
+		station->moved = false;
 		station_init_queues(station);
 		list_add_tail(&station->list, &ctx->stations);
 		ctx->sta_array[i] = station;
@@ -379,35 +1056,25 @@ int load_config(struct wmediumd *ctx, const char *file, const char *per_file, bo
 	}
 	ctx->num_stas = count_ids;
 
-	enable_interference = config_lookup(cf, "ifaces.enable_interference");
-	if (enable_interference &&
-	    config_setting_get_bool(enable_interference)) {
-		ctx->intf = calloc(ctx->num_stas * ctx->num_stas,
-				   sizeof(struct intf_info));
-		if (!ctx->intf) {
-			w_flogf(ctx, LOG_ERR, stderr, "Out of memory(intf)\n");
-			return -ENOMEM;
-		}
-		for (i = 0; i < ctx->num_stas; i++)
-			for (j = 0; j < ctx->num_stas; j++)
-				ctx->intf[i * ctx->num_stas + j].signal = -200;
-	} else {
-		ctx->intf = NULL;
-	}
+	if (parse_interference(ctx, cf))
+		return -EINVAL;
 
-	fading_coefficient =
-		config_lookup(cf, "model.fading_coefficient");
-	if (fading_coefficient &&
-	    config_setting_get_int(fading_coefficient) > 0) {
-		ctx->get_fading_signal = _get_fading_signal;
-		ctx->fading_coefficient =
-			config_setting_get_int(fading_coefficient);
-	} else {
-		ctx->get_fading_signal = get_no_fading_signal;
-		ctx->fading_coefficient = 0;
-	}
+	if (parse_contention(ctx, cf))
+		return -EINVAL;
+
+	if (parse_fading(ctx, cf))
+		return -EINVAL;
 
 	ctx->move_stations = move_stations_donothing;
+	ctx->snr_matrix_back = NULL;
+	ctx->link_epoch = 1;
+	ctx->path_loss_state = NULL;
+	ctx->get_reachable_stations = NULL;
+	ctx->mobility_trace = NULL;
+	ctx->obstacles = NULL;
+	ctx->antennas = NULL;
+	ctx->antenna_num = 0;
+	ctx->sta_antennas = NULL;
 
 	/* create link quality matrix */
 	ctx->snr_matrix = calloc(sizeof(int), count_ids * count_ids);
@@ -419,6 +1086,8 @@ int load_config(struct wmediumd *ctx, const char *file, const char *per_file, bo
 	for (i = 0; i < count_ids * count_ids; i++)
 		ctx->snr_matrix[i] = SNR_DEFAULT;
 
+	ctx->get_link_snr = get_link_snr_from_snr_matrix;
+
 	links = config_lookup(cf, "ifaces.links");
 	if (!links) {
 		model_type = config_lookup(cf, "model.type");
@@ -444,14 +1113,27 @@ int load_config(struct wmediumd *ctx, const char *file, const char *per_file, bo
 		goto fail;
 	}
 
-	ctx->get_link_snr = get_link_snr_from_snr_matrix;
 	ctx->get_error_prob = _get_error_prob_from_snr;
 
 	ctx->per_matrix = NULL;
 	ctx->per_matrix_row_num = 0;
 	if (per_file && read_per_file(ctx, per_file))
 		goto fail;
-	if (!per_file && !error_probs)
+
+	ctx->per_classes = NULL;
+	ctx->per_class_num = 0;
+	ctx->per_class_matrix = NULL;
+	ctx->per_class_default = PER_CLASS_NONE;
+	per_classes = config_lookup(cf, "model.per_classes");
+	if (per_classes && error_probs) {
+		w_flogf(ctx, LOG_ERR, stderr,
+			"per_classes and error_probs could not be used at the same time\n");
+		goto fail;
+	}
+	if (per_classes && parse_per_classes(ctx, cf))
+		goto fail;
+
+	if (!per_file && !error_probs && !per_classes)
 		goto fail;
 
 	ctx->error_prob_matrix = NULL;
@@ -0,0 +1,169 @@
+/*
+ * Slot-accurate EDCA contention of all queues of all stations.
+ *
+ * The counters are kept in flat arrays padded to whole bitset words so
+ * the per-round passes are plain loops over 16 bit values that the
+ * compiler vectorizes.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "edca.h"
+
+struct edca *edca_create(int num)
+{
+	struct edca *edca;
+
+	edca = calloc(1, sizeof(*edca));
+	if (!edca)
+		return NULL;
+
+	if (edca_resize(edca, num)) {
+		edca_free(edca);
+		return NULL;
+	}
+	return edca;
+}
+
+void edca_free(struct edca *edca)
+{
+	if (!edca)
+		return;
+	free(edca->wait);
+	free(edca->aifsn);
+	free(edca->late);
+	free(edca->winners);
+	free(edca);
+}
+
+int edca_resize(struct edca *edca, int num)
+{
+	int words = (num + 63) / 64;
+	uint16_t *wait, *aifsn, *late;
+	uint64_t *winners;
+	int i;
+
+	if (words > edca->words) {
+		wait = realloc(edca->wait, words * 64 * sizeof(*wait));
+		if (!wait)
+			return -ENOMEM;
+		edca->wait = wait;
+
+		aifsn = realloc(edca->aifsn, words * 64 * sizeof(*aifsn));
+		if (!aifsn)
+			return -ENOMEM;
+		edca->aifsn = aifsn;
+
+		late = realloc(edca->late, words * 64 * sizeof(*late));
+		if (!late)
+			return -ENOMEM;
+		edca->late = late;
+
+		winners = realloc(edca->winners, words * sizeof(*winners));
+		if (!winners)
+			return -ENOMEM;
+		edca->winners = winners;
+
+		for (i = edca->words * 64; i < words * 64; i++) {
+			edca->wait[i] = EDCA_IDLE;
+			edca->aifsn[i] = 0;
+			edca->late[i] = 0;
+		}
+		for (i = edca->words; i < words; i++)
+			edca->winners[i] = 0;
+		edca->words = words;
+	}
+
+	if (num > edca->num)
+		edca->num = num;
+	return 0;
+}
+
+void edca_remove(struct edca *edca, int first, int count)
+{
+	int len = edca->words * 64;
+	int i;
+
+	for (i = first; i < first + count; i++)
+		edca_stop(edca, i);
+
+	memmove(&edca->wait[first], &edca->wait[first + count],
+		(len - first - count) * sizeof(*edca->wait));
+	memmove(&edca->aifsn[first], &edca->aifsn[first + count],
+		(len - first - count) * sizeof(*edca->aifsn));
+	memmove(&edca->late[first], &edca->late[first + count],
+		(len - first - count) * sizeof(*edca->late));
+	for (i = len - count; i < len; i++) {
+		edca->wait[i] = EDCA_IDLE;
+		edca->aifsn[i] = 0;
+		edca->late[i] = 0;
+	}
+	edca->num -= count;
+	memset(edca->winners, 0, edca->words * sizeof(*edca->winners));
+}
+
+int edca_next_round(struct edca *edca)
+{
+	uint16_t *wait = edca->wait;
+	uint16_t m = EDCA_IDLE;
+	int i;
+
+	for (i = 0; i < edca->words * 64; i++)
+		m = wait[i] < m ? wait[i] : m;
+	return m;
+}
+
+int edca_contend(struct edca *edca, int slots)
+{
+	uint16_t *wait = edca->wait, *aifsn = edca->aifsn, *late = edca->late;
+	uint16_t m = slots, d, t;
+	uint64_t bits;
+	int i, w, winners = 0;
+
+	if (m == EDCA_IDLE) {
+		memset(edca->winners, 0, edca->words * sizeof(*edca->winners));
+		return 0;
+	}
+
+	/* the next busy period ends the late start of everybody */
+	for (w = 0; w < edca->words; w++) {
+		bits = 0;
+		for (i = w * 64; i < (w + 1) * 64; i++) {
+			bits |= (uint64_t)(wait[i] == m) << (i & 63);
+			t = aifsn[i] + late[i];
+			d = m > t ? m - t : 0;
+			wait[i] -= wait[i] != EDCA_IDLE ? d + late[i] : 0;
+			late[i] = 0;
+		}
+		edca->winners[w] = bits;
+		winners += __builtin_popcountll(bits);
+	}
+
+	/* the winners transmit now, the caller restarts them */
+	for (w = 0; w < edca->words; w++) {
+		for (bits = edca->winners[w]; bits; bits &= bits - 1)
+			wait[w * 64 + __builtin_ctzll(bits)] = EDCA_IDLE;
+	}
+	edca->active -= winners;
+
+	return winners;
+}
+
+int edca_next_winner(struct edca *edca, int from)
+{
+	int w = from / 64;
+	uint64_t bits;
+
+	if (from < 0 || w >= edca->words)
+		return -1;
+
+	bits = edca->winners[w] & (~0ULL << (from & 63));
+	while (!bits) {
+		if (++w >= edca->words)
+			return -1;
+		bits = edca->winners[w];
+	}
+	return w * 64 + __builtin_ctzll(bits);
+}
@@ -0,0 +1,122 @@
+/*
+ * Slot-accurate EDCA contention of all queues of all stations.
+ */
+
+#ifndef WMEDIUMD_EDCA_H
+#define WMEDIUMD_EDCA_H
+
+#include <stdint.h>
+
+/**
+ * Wait of a queue that does not contend
+ */
+#define EDCA_IDLE	(UINT16_MAX)
+
+/**
+ * Backoff state of all contenders.  Every contender waits for its AIFSN
+ * and then for its remaining backoff in idle slots after each busy period.
+ * A contender that joins while the medium is idle starts waiting late.
+ */
+struct edca {
+	int num;		/* contenders */
+	int active;		/* contenders that are not idle */
+	int words;		/* 64 bit words of the winner bitset */
+	uint16_t *wait;		/* idle slots before the contender joined
+				   + AIFSN + remaining backoff [slots] */
+	uint16_t *aifsn;	/* [slots] */
+	uint16_t *late;		/* idle slots before the contender joined */
+	uint64_t *winners;	/* contenders that won the last round */
+};
+
+/**
+ * Create the backoff state of idle contenders
+ * @param num The number of contenders
+ * @return The state or NULL on error
+ */
+struct edca *edca_create(int num);
+
+/**
+ * Free the backoff state
+ * @param edca The state
+ */
+void edca_free(struct edca *edca);
+
+/**
+ * Grow the number of contenders, new contenders are idle
+ * @param edca The state
+ * @param num The new number of contenders
+ * @return 0 on success, -ENOMEM on error
+ */
+int edca_resize(struct edca *edca, int num);
+
+/**
+ * Remove contenders, the following ones move down
+ * @param edca The state
+ * @param first The index of the first contender to remove
+ * @param count The number of contenders to remove
+ */
+void edca_remove(struct edca *edca, int first, int count);
+
+/**
+ * Let a contender contend with a new backoff
+ * @param edca The state
+ * @param idx The index of the contender
+ * @param aifsn The arbitration inter-frame space number [slots]
+ * @param backoff The backoff, drawn from [0, CW] by the caller [slots]
+ * @param late The idle slots that already passed when the contender
+ *	joined, 0 if the medium is busy [slots]
+ */
+static inline void edca_start(struct edca *edca, int idx, int aifsn,
+			      int backoff, int late)
+{
+	if (edca->wait[idx] == EDCA_IDLE)
+		edca->active++;
+	if (late > EDCA_IDLE - 1 - aifsn - backoff)
+		late = EDCA_IDLE - 1 - aifsn - backoff;
+	edca->aifsn[idx] = aifsn;
+	edca->late[idx] = late;
+	edca->wait[idx] = late + aifsn + backoff;
+}
+
+/**
+ * Stop a contender from contending
+ * @param edca The state
+ * @param idx The index of the contender
+ */
+static inline void edca_stop(struct edca *edca, int idx)
+{
+	if (edca->wait[idx] != EDCA_IDLE)
+		edca->active--;
+	edca->wait[idx] = EDCA_IDLE;
+}
+
+/**
+ * Find when the next contention round ends the idle period
+ * @param edca The state
+ * @return The idle slots before the next transmission or EDCA_IDLE if
+ *	nobody contends
+ */
+int edca_next_round(struct edca *edca);
+
+/**
+ * Run one contention round on an idle medium.  The idle slots up to the
+ * first transmission are skipped at once, every contender counts down
+ * its backoff by the slots that passed after it joined and its AIFS.
+ * The winners are stopped, the caller starts them again if they still
+ * have frames.
+ * @param edca The state
+ * @param slots The idle slots before the transmission, as found by
+ *	edca_next_round()
+ * @return The number of winners, more than one is a collision
+ */
+int edca_contend(struct edca *edca, int slots);
+
+/**
+ * Find the next winner of the last round
+ * @param edca The state
+ * @param from The index to start the search at
+ * @return The index of the winner or -1 if there is none
+ */
+int edca_next_winner(struct edca *edca, int from);
+
+#endif //WMEDIUMD_EDCA_H
@@ -0,0 +1,220 @@
+/*
+ * Time-correlated Rayleigh/Rician fading per link.
+ *
+ * Every link that carries frames owns the complex gain h of a first-order
+ * Gauss-Markov process.  The process is only advanced when the link is
+ * used: after dt the gain becomes
+ *
+ *   h' = rho * h + sqrt(1 - rho^2) * w,   rho = exp(-dt / T_c)
+ *
+ * with w complex normal, so h stays CN(0, 1) distributed and decorrelates
+ * over the coherence time T_c.  The received power is |h|^2 (Rayleigh) or
+ * |sqrt(K / (K + 1)) + sqrt(1 / (K + 1)) * h|^2 (Rician).
+ *
+ * Links are symmetric and kept in an open-addressing hash table, so the
+ * memory grows with the number of active links only.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+
+#include "fading.h"
+
+#define FADING_TABLE_MIN_SIZE	(64)
+#define FADING_MIN_GAIN		(1e-6)	/* floor of deep fades, -60 dB */
+
+struct fading_link {
+	u64 key;			/* 0 marks an empty slot */
+	float re, im;			/* complex gain */
+	u64 updated;			/* last update [usec] */
+};
+
+struct correlated_fading {
+	enum fading_model_type type;
+	double coherence_time;		/* [usec] */
+	double los_amplitude;		/* sqrt(K / (K + 1)) */
+	double nlos_amplitude;		/* sqrt(1 / (K + 1)) */
+	struct fading_link *links;
+	size_t size;			/* power of two */
+	size_t used;
+};
+
+static inline u64 fading_key(int a, int b)
+{
+	if (a > b) {
+		int t = a;
+
+		a = b;
+		b = t;
+	}
+	return (((u64)(u32)a << 32) | (u32)b) + 1;
+}
+
+static inline size_t fading_hash(u64 key, size_t size)
+{
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+	return key & (size - 1);
+}
+
+static int fading_grow(struct correlated_fading *f)
+{
+	struct fading_link *old = f->links;
+	size_t old_size = f->size, i, j;
+
+	f->size = old_size ? old_size * 2 : FADING_TABLE_MIN_SIZE;
+	f->links = calloc(f->size, sizeof(*f->links));
+	if (!f->links) {
+		f->links = old;
+		f->size = old_size;
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < old_size; i++) {
+		if (!old[i].key)
+			continue;
+		j = fading_hash(old[i].key, f->size);
+		while (f->links[j].key)
+			j = (j + 1) & (f->size - 1);
+		f->links[j] = old[i];
+	}
+	free(old);
+	return 0;
+}
+
+static struct fading_link *fading_lookup(struct correlated_fading *f,
+					 u64 key, bool *created)
+{
+	size_t i;
+
+	*created = false;
+	if (2 * (f->used + 1) > f->size && fading_grow(f))
+		return NULL;
+
+	i = fading_hash(key, f->size);
+	while (f->links[i].key && f->links[i].key != key)
+		i = (i + 1) & (f->size - 1);
+
+	if (!f->links[i].key) {
+		f->links[i].key = key;
+		f->used++;
+		*created = true;
+	}
+	return &f->links[i];
+}
+
+/*
+ * Move the links to a new table of the same size, dropping those of a
+ * removed station and renumbering the stations following it
+ */
+void correlated_fading_remove_station(struct wmediumd *ctx, int idx)
+{
+	struct correlated_fading *f = ctx->fading_param;
+	struct fading_link *old = f->links;
+	size_t i, j;
+	int a, b;
+
+	if (!f->used)
+		return;
+
+	f->links = calloc(f->size, sizeof(*f->links));
+	if (!f->links) {
+		/* start all links over instead */
+		free(old);
+		f->size = 0;
+		f->used = 0;
+		return;
+	}
+
+	f->used = 0;
+	for (i = 0; i < f->size; i++) {
+		if (!old[i].key)
+			continue;
+		a = (int)((old[i].key - 1) >> 32);
+		b = (int)(u32)(old[i].key - 1);
+		if (a == idx || b == idx)
+			continue;
+
+		old[i].key = fading_key(a > idx ? a - 1 : a,
+					b > idx ? b - 1 : b);
+		j = fading_hash(old[i].key, f->size);
+		while (f->links[j].key)
+			j = (j + 1) & (f->size - 1);
+		f->links[j] = old[i];
+		f->used++;
+	}
+	free(old);
+}
+
+void correlated_fading_free(struct wmediumd *ctx)
+{
+	struct correlated_fading *f = ctx->fading_param;
+
+	if (!f)
+		return;
+	free(f->links);
+	free(f);
+	ctx->fading_param = NULL;
+}
+
+int correlated_fading_init(struct wmediumd *ctx, enum fading_model_type type,
+			   double coherence_time, double k_factor_db)
+{
+	struct correlated_fading *f;
+	double k = 0.0;
+
+	f = calloc(1, sizeof(*f));
+	if (!f)
+		return -ENOMEM;
+
+	if (type == FADING_RICIAN)
+		k = pow(10.0, k_factor_db / 10.0);
+
+	f->type = type;
+	f->coherence_time = coherence_time;
+	f->los_amplitude = sqrt(k / (k + 1.0));
+	f->nlos_amplitude = sqrt(1.0 / (k + 1.0));
+
+	ctx->fading_param = f;
+	ctx->get_fading_signal = get_correlated_fading_signal;
+	return 0;
+}
+
+int get_correlated_fading_signal(struct wmediumd *ctx, struct station *src,
+				 struct station *dst, struct rng_stream *rng)
+{
+	struct correlated_fading *f = ctx->fading_param;
+	struct fading_link *link;
+	struct timespec now;
+	double rho, sigma, re, im, gain;
+	bool created;
+	u64 now_usec;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	now_usec = (u64)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+
+	link = fading_lookup(f, fading_key(src->index, dst->index), &created);
+	if (!link)
+		return 0;
+
+	/* a new link starts from the stationary distribution */
+	rho = created ? 0.0 :
+		exp(-(double)(now_usec - link->updated) / f->coherence_time);
+	sigma = sqrt((1.0 - rho * rho) / 2.0);
+
+	link->re = rho * link->re + sigma * rng_stream_normal(rng);
+	link->im = rho * link->im + sigma * rng_stream_normal(rng);
+	link->updated = now_usec;
+
+	re = f->los_amplitude + f->nlos_amplitude * link->re;
+	im = f->nlos_amplitude * link->im;
+	gain = re * re + im * im;
+	if (gain < FADING_MIN_GAIN)
+		gain = FADING_MIN_GAIN;
+
+	return (int)floor(10.0 * log10(gain) + 0.5);
+}
@@ -0,0 +1,50 @@
+/*
+ * Time-correlated Rayleigh/Rician fading per link.
+ */
+
+#ifndef WMEDIUMD_FADING_H
+#define WMEDIUMD_FADING_H
+
+#include "wmediumd.h"
+
+enum fading_model_type {
+	FADING_RAYLEIGH,
+	FADING_RICIAN,
+};
+
+/**
+ * Set up correlated fading for all links of a context
+ * @param ctx The wmediumd context
+ * @param type The fading model
+ * @param coherence_time The coherence time of every link [usec]
+ * @param k_factor_db The Rician K-factor [dB], ignored for Rayleigh
+ * @return 0 on success otherwise a negative errno value
+ */
+int correlated_fading_init(struct wmediumd *ctx, enum fading_model_type type,
+			   double coherence_time, double k_factor_db);
+
+/**
+ * Advance the fading process of a link to now and return its gain
+ * @param ctx The wmediumd context
+ * @param src The sending station
+ * @param dst The receiving station
+ * @param rng The random stream of the current frame
+ * @return The fading gain [dB]
+ */
+int get_correlated_fading_signal(struct wmediumd *ctx, struct station *src,
+				 struct station *dst, struct rng_stream *rng);
+
+/**
+ * Drop the links of a removed station and renumber the following stations
+ * @param ctx The wmediumd context, after correlated_fading_init()
+ * @param idx The index the station had
+ */
+void correlated_fading_remove_station(struct wmediumd *ctx, int idx);
+
+/**
+ * Free the links, if correlated fading was set up
+ * @param ctx The wmediumd context
+ */
+void correlated_fading_free(struct wmediumd *ctx);
+
+#endif //WMEDIUMD_FADING_H
@@ -39,7 +39,9 @@
 #define FTYPE_MGMT		0x00
 #define FTYPE_DATA		0x08
 
+#define STYPE_PROBE_REQ		0x40
 #define STYPE_QOS_DATA		0x80
+#define FCTL_STYPE		0xf0
 
 #define QOS_CTL_TAG1D_MASK	0x07
 
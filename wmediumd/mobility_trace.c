@@ -0,0 +1,291 @@
+/*
+ * Playback of ns-2 setdest style mobility traces, as written by the ns-2
+ * setdest tool and exported by BonnMotion:
+ *
+ *   $node_(0) set X_ 150.0
+ *   $node_(0) set Y_ 93.0
+ *   $ns_ at 2.5 "$node_(0) setdest 10.0 20.0 5.0"
+ *
+ * Node n is the station with index n and trace time 0 is the start of
+ * the playback.  The file is read while it plays, keeping only the events
+ * of the next MOBILITY_TRACE_WINDOW seconds in a heap, so events have to
+ * be sorted by time up to that window.  Events are applied at their own
+ * time even when they are noticed a bit later, as positions are a
+ * function of time.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+
+#include "mobility_trace.h"
+#include "path_loss.h"
+
+enum trace_event_type {
+	TRACE_SET_X,
+	TRACE_SET_Y,
+	TRACE_SETDEST,
+};
+
+struct trace_event {
+	double time;			/* [s] since the start */
+	unsigned long seq;		/* keeps events of a time in order */
+	enum trace_event_type type;
+	int node;
+	double x, y;			/* [m] */
+	double speed;			/* [m/s] */
+};
+
+struct mobility_trace {
+	FILE *file;
+	unsigned long line;
+	double start;			/* [s, CLOCK_MONOTONIC] */
+	double read_until;		/* time of the latest event read */
+	double next;			/* time of the next event to apply */
+	struct trace_event *heap;
+	size_t len, size;
+	unsigned long seq;
+};
+
+static double monotonic_sec(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1000000000.0;
+}
+
+static bool event_before(const struct trace_event *a,
+			 const struct trace_event *b)
+{
+	return a->time < b->time || (a->time == b->time && a->seq < b->seq);
+}
+
+static int heap_push(struct mobility_trace *trace, struct trace_event *ev)
+{
+	struct trace_event *heap, tmp;
+	size_t i, parent;
+
+	if (trace->len == trace->size) {
+		size_t size = trace->size ? trace->size * 2 : 64;
+
+		heap = realloc(trace->heap, size * sizeof(*heap));
+		if (!heap)
+			return -ENOMEM;
+		trace->heap = heap;
+		trace->size = size;
+	}
+
+	heap = trace->heap;
+	i = trace->len++;
+	heap[i] = *ev;
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (!event_before(&heap[i], &heap[parent]))
+			break;
+		tmp = heap[i];
+		heap[i] = heap[parent];
+		heap[parent] = tmp;
+		i = parent;
+	}
+
+	return 0;
+}
+
+static void heap_pop(struct mobility_trace *trace, struct trace_event *ev)
+{
+	struct trace_event *heap = trace->heap, tmp;
+	size_t i = 0, child;
+
+	*ev = heap[0];
+	heap[0] = heap[--trace->len];
+	while ((child = 2 * i + 1) < trace->len) {
+		if (child + 1 < trace->len &&
+		    event_before(&heap[child + 1], &heap[child]))
+			child++;
+		if (!event_before(&heap[child], &heap[i]))
+			break;
+		tmp = heap[i];
+		heap[i] = heap[child];
+		heap[child] = tmp;
+		i = child;
+	}
+}
+
+/*
+ * Parse a line of the trace
+ *
+ * Returns 1 for an event, 0 for lines without one.
+ */
+static int parse_line(const char *line, struct trace_event *ev)
+{
+	char axis;
+	double value;
+
+	memset(ev, 0, sizeof(*ev));
+
+	if (sscanf(line, " $node_(%d) set %c_ %lf", &ev->node, &axis,
+		   &value) == 3) {
+		if (axis == 'X') {
+			ev->type = TRACE_SET_X;
+			ev->x = value;
+			return 1;
+		}
+		if (axis == 'Y') {
+			ev->type = TRACE_SET_Y;
+			ev->y = value;
+			return 1;
+		}
+		return 0;
+	}
+
+	if (sscanf(line, " $ns_ at %lf \"$node_(%d) setdest %lf %lf %lf\"",
+		   &ev->time, &ev->node, &ev->x, &ev->y, &ev->speed) == 5) {
+		ev->type = TRACE_SETDEST;
+		return 1;
+	}
+
+	return 0;
+}
+
+/* Read events until one is later than a time or the trace ends */
+static int read_events(struct wmediumd *ctx, struct mobility_trace *trace,
+		       double until)
+{
+	struct trace_event ev;
+	char *line = NULL;
+	size_t n = 0;
+	int ret = 0;
+
+	while (trace->file && trace->read_until <= until) {
+		if (getline(&line, &n, trace->file) < 0) {
+			fclose(trace->file);
+			trace->file = NULL;
+			break;
+		}
+		trace->line++;
+
+		if (!parse_line(line, &ev))
+			continue;
+		if (ev.node < 0 || ev.node >= ctx->num_stas) {
+			w_logf(ctx, LOG_WARNING,
+			       "Mobility trace line %lu: no station %d\n",
+			       trace->line, ev.node);
+			continue;
+		}
+
+		ev.seq = trace->seq++;
+		ret = heap_push(trace, &ev);
+		if (ret)
+			break;
+		if (ev.time > trace->read_until)
+			trace->read_until = ev.time;
+	}
+
+	free(line);
+	return ret;
+}
+
+static void apply_event(struct wmediumd *ctx, struct mobility_trace *trace,
+			struct trace_event *ev)
+{
+	double t = trace->start + ev->time;
+	double x, y, dx, dy, dist;
+	int ret;
+
+	path_loss_get_position(ctx, ev->node, t, &x, &y);
+
+	switch (ev->type) {
+	case TRACE_SET_X:
+		ret = path_loss_set_trajectory(ctx, ev->node, t, ev->x, y,
+					       0.0, 0.0, INFINITY);
+		break;
+	case TRACE_SET_Y:
+		ret = path_loss_set_trajectory(ctx, ev->node, t, x, ev->y,
+					       0.0, 0.0, INFINITY);
+		break;
+	case TRACE_SETDEST:
+	default:
+		dx = ev->x - x;
+		dy = ev->y - y;
+		dist = sqrt(dx * dx + dy * dy);
+		if (dist == 0.0 || ev->speed <= 0.0)
+			ret = path_loss_set_trajectory(ctx, ev->node, t, x, y,
+						       0.0, 0.0, INFINITY);
+		else
+			ret = path_loss_set_trajectory(ctx, ev->node, t, x, y,
+				ev->speed * dx / dist, ev->speed * dy / dist,
+				t + dist / ev->speed);
+		break;
+	}
+
+	if (ret)
+		w_flogf(ctx, LOG_ERR, stderr,
+			"Out of memory(mobility_trace)\n");
+}
+
+/* Apply all events up to a time */
+static void mobility_trace_advance(struct wmediumd *ctx, double now)
+{
+	struct mobility_trace *trace = ctx->mobility_trace;
+	struct trace_event ev;
+	double t = now - trace->start;
+
+	if (t < trace->next)
+		return;
+
+	if (read_events(ctx, trace, t + MOBILITY_TRACE_WINDOW))
+		w_flogf(ctx, LOG_ERR, stderr,
+			"Out of memory(mobility_trace)\n");
+
+	while (trace->len && trace->heap[0].time <= t) {
+		heap_pop(trace, &ev);
+		/* the station may have been removed since it was read */
+		if (ev.node < ctx->num_stas)
+			apply_event(ctx, trace, &ev);
+	}
+
+	trace->next = trace->len ? trace->heap[0].time : INFINITY;
+}
+
+int get_link_snr_trace(struct wmediumd *ctx, struct station *sender,
+		       struct station *receiver)
+{
+	mobility_trace_advance(ctx, monotonic_sec());
+	return get_link_snr_continuous(ctx, sender, receiver);
+}
+
+void move_stations_trace(struct wmediumd *ctx)
+{
+	mobility_trace_advance(ctx, monotonic_sec());
+	move_stations_continuous(ctx);
+}
+
+int init_mobility_trace(struct wmediumd *ctx, const char *file_name)
+{
+	struct mobility_trace *trace;
+
+	trace = calloc(1, sizeof(*trace));
+	if (!trace)
+		return -ENOMEM;
+
+	trace->file = fopen(file_name, "r");
+	if (!trace->file) {
+		w_flogf(ctx, LOG_ERR, stderr,
+			"Cannot open mobility trace %s\n", file_name);
+		free(trace);
+		return -EINVAL;
+	}
+	trace->start = monotonic_sec();
+	ctx->mobility_trace = trace;
+
+	/* initial positions */
+	mobility_trace_advance(ctx, trace->start);
+
+	ctx->get_link_snr = get_link_snr_trace;
+	ctx->move_stations = move_stations_trace;
+
+	return 0;
+}
@@ -0,0 +1,37 @@
+/*
+ * Playback of ns-2 setdest style mobility traces.
+ */
+
+#ifndef WMEDIUMD_MOBILITY_TRACE_H
+#define WMEDIUMD_MOBILITY_TRACE_H
+
+#include "wmediumd.h"
+
+/* how far ahead of the current time the trace is read [s] */
+#define MOBILITY_TRACE_WINDOW	(10.0)
+
+/**
+ * Start playing a mobility trace, needs continuous mobility
+ * @param ctx The wmediumd context
+ * @param file_name The trace file
+ * @return 0 on success otherwise a negative errno value
+ */
+int init_mobility_trace(struct wmediumd *ctx, const char *file_name);
+
+/**
+ * Get the SNR of a link after applying the due trace events
+ * @param ctx The wmediumd context
+ * @param sender The sending station
+ * @param receiver The receiving station
+ * @return The SNR [dB]
+ */
+int get_link_snr_trace(struct wmediumd *ctx, struct station *sender,
+		       struct station *receiver);
+
+/**
+ * Apply the due trace events and refresh the station positions
+ * @param ctx The wmediumd context
+ */
+void move_stations_trace(struct wmediumd *ctx);
+
+#endif //WMEDIUMD_MOBILITY_TRACE_H
@@ -0,0 +1,361 @@
+/*
+ * Walls and floors attenuating the signal between stations.
+ *
+ * The obstacles are kept in a bounding volume hierarchy of axis aligned
+ * boxes, built once with splits chosen by the surface area heuristic, so
+ * a segment between two stations is only tested against the few obstacles
+ * whose boxes it passes through.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "obstacles.h"
+
+#define BVH_LEAF_SIZE	(4)	/* largest leaf that may skip a split */
+#define BVH_BINS	(12)
+#define BVH_MAX_DEPTH	(64)
+#define OBSTACLE_EPS	(1e-9f)
+
+struct obstacle_data {
+	float origin[3], u[3], v[3];
+	float normal[3];
+	float uu, uv, vv, det;
+	float loss;
+};
+
+struct bvh_node {
+	float min[3], max[3];
+	int first;		/* first obstacle of a leaf or right child */
+	int count;		/* number of obstacles, 0 for inner nodes */
+};
+
+struct obstacles {
+	struct obstacle_data *data;
+	int num;
+	struct bvh_node *nodes;
+	int num_nodes;
+};
+
+static inline float dot3(const float a[3], const float b[3])
+{
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static void bounds(const struct obstacle_data *o, float min[3], float max[3])
+{
+	float p;
+	int k;
+
+	for (k = 0; k < 3; k++) {
+		min[k] = max[k] = o->origin[k];
+		p = o->origin[k] + o->u[k];
+		min[k] = fminf(min[k], p);
+		max[k] = fmaxf(max[k], p);
+		p = o->origin[k] + o->v[k];
+		min[k] = fminf(min[k], p);
+		max[k] = fmaxf(max[k], p);
+		p = o->origin[k] + o->u[k] + o->v[k];
+		min[k] = fminf(min[k], p);
+		max[k] = fmaxf(max[k], p);
+	}
+}
+
+static float centroid(const struct obstacle_data *o, int axis)
+{
+	return o->origin[axis] + (o->u[axis] + o->v[axis]) / 2;
+}
+
+static float half_area(const float min[3], const float max[3])
+{
+	float dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+
+	return dx * dy + dy * dz + dz * dx;
+}
+
+static void grow(float min[3], float max[3], const float omin[3],
+		 const float omax[3])
+{
+	int k;
+
+	for (k = 0; k < 3; k++) {
+		min[k] = fminf(min[k], omin[k]);
+		max[k] = fmaxf(max[k], omax[k]);
+	}
+}
+
+static void reset_bounds(float min[3], float max[3])
+{
+	int k;
+
+	for (k = 0; k < 3; k++) {
+		min[k] = INFINITY;
+		max[k] = -INFINITY;
+	}
+}
+
+static inline int bin_of(float c, float lo, float scale)
+{
+	int bin = (int)((c - lo) * scale);
+
+	return bin < 0 ? 0 : bin >= BVH_BINS ? BVH_BINS - 1 : bin;
+}
+
+/*
+ * Find the split with the lowest surface area heuristic among BVH_BINS
+ * bins of the centroids along each axis.  Returns the number of obstacles
+ * on the left, 0 if splitting costs more than testing all of them.
+ */
+static int bvh_split(struct obstacles *obs, const struct bvh_node *n,
+		     int first, int count)
+{
+	float cmin[3], cmax[3], min[3], max[3], c, scale, cost, best = INFINITY;
+	float bmin[BVH_BINS][3], bmax[BVH_BINS][3], right[BVH_BINS];
+	int bcount[BVH_BINS], best_axis = -1, best_bin = 0, i, k, b, num;
+	struct obstacle_data tmp;
+
+	reset_bounds(cmin, cmax);
+	for (i = first; i < first + count; i++) {
+		for (k = 0; k < 3; k++) {
+			c = centroid(&obs->data[i], k);
+			cmin[k] = fminf(cmin[k], c);
+			cmax[k] = fmaxf(cmax[k], c);
+		}
+	}
+
+	for (k = 0; k < 3; k++) {
+		if (cmax[k] <= cmin[k])
+			continue;
+		scale = BVH_BINS / (cmax[k] - cmin[k]);
+
+		memset(bcount, 0, sizeof(bcount));
+		for (b = 0; b < BVH_BINS; b++)
+			reset_bounds(bmin[b], bmax[b]);
+		for (i = first; i < first + count; i++) {
+			b = bin_of(centroid(&obs->data[i], k), cmin[k], scale);
+			bounds(&obs->data[i], min, max);
+			grow(bmin[b], bmax[b], min, max);
+			bcount[b]++;
+		}
+
+		/* area times count of the bins right of each split */
+		reset_bounds(min, max);
+		for (b = BVH_BINS - 1, num = 0; b > 0; b--) {
+			grow(min, max, bmin[b], bmax[b]);
+			num += bcount[b];
+			right[b] = num ? half_area(min, max) * num : 0.0f;
+		}
+		reset_bounds(min, max);
+		for (b = 0, num = 0; b < BVH_BINS - 1; b++) {
+			grow(min, max, bmin[b], bmax[b]);
+			num += bcount[b];
+			cost = (num ? half_area(min, max) * num : 0.0f) +
+			       right[b + 1];
+			if (num && num < count && cost < best) {
+				best = cost;
+				best_axis = k;
+				best_bin = b;
+			}
+		}
+	}
+
+	/* a node is tested at the cost of about one obstacle */
+	if (best_axis < 0 ||
+	    (count <= BVH_LEAF_SIZE &&
+	     best / half_area(n->min, n->max) + 1.0f >= count))
+		return 0;
+
+	scale = BVH_BINS / (cmax[best_axis] - cmin[best_axis]);
+	for (i = first, num = first + count; i < num;) {
+		if (bin_of(centroid(&obs->data[i], best_axis),
+			   cmin[best_axis], scale) <= best_bin) {
+			i++;
+			continue;
+		}
+		tmp = obs->data[i];
+		obs->data[i] = obs->data[--num];
+		obs->data[num] = tmp;
+	}
+
+	return num - first;
+}
+
+/*
+ * Build the subtree of obstacles [first, first + count) at a node.  Past
+ * the depth the traversal stack allows, the rest ends up in one leaf.
+ */
+static void bvh_build(struct obstacles *obs, int node, int first, int count,
+		      int depth)
+{
+	struct bvh_node *n = &obs->nodes[node];
+	float min[3], max[3];
+	int i, left, num;
+
+	reset_bounds(n->min, n->max);
+	for (i = first; i < first + count; i++) {
+		bounds(&obs->data[i], min, max);
+		grow(n->min, n->max, min, max);
+	}
+
+	num = count > 1 && depth < BVH_MAX_DEPTH - 1 ?
+		bvh_split(obs, n, first, count) : 0;
+	if (!num) {
+		n->first = first;
+		n->count = count;
+		return;
+	}
+
+	/* the left child follows its parent, the right one is stored */
+	left = obs->num_nodes++;
+	bvh_build(obs, left, first, num, depth + 1);
+	n = &obs->nodes[node];
+	n->first = obs->num_nodes++;
+	n->count = 0;
+	bvh_build(obs, n->first, first + num, count - num, depth + 1);
+}
+
+struct obstacles *obstacles_create(const struct obstacle *obstacle, int num)
+{
+	struct obstacles *obs;
+	struct obstacle_data *o;
+	int i, k;
+
+	obs = calloc(1, sizeof(*obs));
+	if (!obs)
+		return NULL;
+
+	obs->data = calloc(num ? num : 1, sizeof(*obs->data));
+	obs->nodes = calloc(num ? 2 * num : 1, sizeof(*obs->nodes));
+	if (!obs->data || !obs->nodes) {
+		obstacles_free(obs);
+		return NULL;
+	}
+	obs->num = num;
+
+	for (i = 0; i < num; i++) {
+		o = &obs->data[i];
+		memcpy(o->origin, obstacle[i].origin, sizeof(o->origin));
+		memcpy(o->u, obstacle[i].u, sizeof(o->u));
+		memcpy(o->v, obstacle[i].v, sizeof(o->v));
+		for (k = 0; k < 3; k++)
+			o->normal[k] = o->u[(k + 1) % 3] * o->v[(k + 2) % 3] -
+				       o->u[(k + 2) % 3] * o->v[(k + 1) % 3];
+		o->uu = dot3(o->u, o->u);
+		o->uv = dot3(o->u, o->v);
+		o->vv = dot3(o->v, o->v);
+		o->det = o->uu * o->vv - o->uv * o->uv;
+		o->loss = obstacle[i].loss;
+	}
+
+	if (num) {
+		obs->num_nodes = 1;
+		bvh_build(obs, 0, 0, num, 0);
+	}
+
+	return obs;
+}
+
+void obstacles_free(struct obstacles *obs)
+{
+	if (!obs)
+		return;
+	free(obs->data);
+	free(obs->nodes);
+	free(obs);
+}
+
+/* Whether the segment a + t * d, t in [0, 1], passes through a box */
+static bool segment_hits_box(const float a[3], const float d[3],
+			     const float inv[3], const struct bvh_node *n)
+{
+	float t0 = 0.0f, t1 = 1.0f, near, far, tmp;
+	int k;
+
+	for (k = 0; k < 3; k++) {
+		if (d[k] == 0.0f) {
+			if (a[k] < n->min[k] || a[k] > n->max[k])
+				return false;
+			continue;
+		}
+		near = (n->min[k] - a[k]) * inv[k];
+		far = (n->max[k] - a[k]) * inv[k];
+		if (near > far) {
+			tmp = near;
+			near = far;
+			far = tmp;
+		}
+		t0 = fmaxf(t0, near);
+		t1 = fminf(t1, far);
+		if (t0 > t1)
+			return false;
+	}
+
+	return true;
+}
+
+/* Whether the segment a + t * d, t in (0, 1), passes through an obstacle */
+static bool segment_hits_obstacle(const float a[3], const float d[3],
+				  const struct obstacle_data *o)
+{
+	float denom = dot3(o->normal, d), q[3], t, qu, qv, alpha, beta;
+	int k;
+
+	if (fabsf(denom) < OBSTACLE_EPS || o->det < OBSTACLE_EPS)
+		return false;
+
+	for (k = 0; k < 3; k++)
+		q[k] = o->origin[k] - a[k];
+	t = dot3(o->normal, q) / denom;
+	if (t <= 0.0f || t >= 1.0f)
+		return false;
+
+	for (k = 0; k < 3; k++)
+		q[k] = a[k] + t * d[k] - o->origin[k];
+	qu = dot3(q, o->u);
+	qv = dot3(q, o->v);
+	alpha = (qu * o->vv - qv * o->uv) / o->det;
+	beta = (qv * o->uu - qu * o->uv) / o->det;
+
+	return alpha >= 0.0f && alpha <= 1.0f && beta >= 0.0f && beta <= 1.0f;
+}
+
+float obstacles_loss(const struct obstacles *obs, const float a[3],
+		     const float b[3], float limit)
+{
+	int stack[BVH_MAX_DEPTH], top = 0, node, i;
+	const struct bvh_node *n;
+	float d[3], inv[3], loss = 0.0f;
+	int k;
+
+	if (!obs || !obs->num)
+		return 0.0f;
+
+	for (k = 0; k < 3; k++) {
+		d[k] = b[k] - a[k];
+		inv[k] = d[k] != 0.0f ? 1.0f / d[k] : 0.0f;
+	}
+
+	stack[top++] = 0;
+	while (top) {
+		node = stack[--top];
+		n = &obs->nodes[node];
+		if (!segment_hits_box(a, d, inv, n))
+			continue;
+
+		if (n->count) {
+			for (i = n->first; i < n->first + n->count; i++)
+				if (segment_hits_obstacle(a, d, &obs->data[i]))
+					loss += obs->data[i].loss;
+			if (loss >= limit)
+				break;
+			continue;
+		}
+
+		stack[top++] = node + 1;
+		stack[top++] = n->first;
+	}
+
+	return loss;
+}
@@ -0,0 +1,44 @@
+/*
+ * Walls and floors attenuating the signal between stations.
+ */
+
+#ifndef WMEDIUMD_OBSTACLES_H
+#define WMEDIUMD_OBSTACLES_H
+
+/*
+ * A parallelogram spanned by u and v from its origin, e.g. a wall or a
+ * floor.  A signal passing through it loses a fixed amount of power.
+ */
+struct obstacle {
+	float origin[3], u[3], v[3];	/* [m] */
+	float loss;			/* [dB] */
+};
+
+struct obstacles;
+
+/**
+ * Build the bounding volume hierarchy of obstacles
+ * @param obstacle The obstacles, copied
+ * @param num The number of obstacles
+ * @return The obstacles or NULL if out of memory
+ */
+struct obstacles *obstacles_create(const struct obstacle *obstacle, int num);
+
+/**
+ * Free obstacles
+ * @param obs The obstacles
+ */
+void obstacles_free(struct obstacles *obs);
+
+/**
+ * Sum up the loss of the obstacles between two points
+ * @param obs The obstacles
+ * @param a The first point [m]
+ * @param b The second point [m]
+ * @param limit The loss at which to stop summing up [dB]
+ * @return The loss, at least limit if it was reached [dB]
+ */
+float obstacles_loss(const struct obstacles *obs, const float a[3],
+		     const float b[3], float limit);
+
+#endif //WMEDIUMD_OBSTACLES_H
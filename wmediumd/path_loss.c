@@ -0,0 +1,1954 @@
+/*
+ * Path loss models and the recalculation of the SNR matrix from station
+ * positions.
+ *
+ * Positions and tx powers are mirrored into contiguous arrays indexed by
+ * station, and each model provides a kernel that computes the path loss
+ * from one station to all others at once.  The kernels work on vectors of
+ * four floats and avoid sqrt() by taking the logarithm of the squared
+ * distance with a polynomial approximation of log2().
+ *
+ * Rows are independent of each other, so large matrices are recalculated
+ * by a small pool of threads, each owning a contiguous range of rows.
+ * A grid over the positions restricts the evaluation to the stations that
+ * are close enough to sense each other.  The gains of directional antennas
+ * and the loss of walls and floors between two stations are added on top
+ * of the model.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "path_loss.h"
+#include "obstacles.h"
+#include "antenna.h"
+#include "worker_pool.h"
+#include "wmediumd_dynamic.h"
+
+#define SPEED_LIGHT (2.99792458e8)	// [meter/sec]
+
+#define PATH_LOSS_VEC_LEN	(4)
+/* topologies from this size on get a thread pool by default */
+#define PATH_LOSS_PARALLEL_MIN_STAS	(256)
+#define PATH_LOSS_MAX_THREADS		(8)
+/* shortest time between two crossings of a pair [s] */
+#define KINETIC_MIN_INTERVAL	(1e-3)
+/* path loss of stations out of range, far beyond any real link */
+#define PATH_LOSS_UNREACHABLE	(1e4f)
+/* co-located stations are treated as 1 mm apart */
+#define PATH_LOSS_MIN_DIST2	(1e-6f)
+
+typedef float v4sf __attribute__((vector_size(16)));
+typedef int v4si __attribute__((vector_size(16)));
+
+/*
+ * log2(x) for positive, normal x.  The mantissa is approximated by a
+ * degree 5 polynomial fitted at the Chebyshev nodes of [1, 2), the
+ * absolute error stays below 2e-5.  That is below 2e-4 dB of path loss
+ * for any path loss exponent up to 6; together with single precision
+ * positions the kernel stays within 1e-3 dB of the scalar model.
+ */
+static inline v4sf fast_log2(v4sf x)
+{
+	v4si bits = (v4si)x;
+	v4sf e = __builtin_convertvector(((bits >> 23) & 0xff) - 127, v4sf);
+	v4sf t = (v4sf)((bits & 0x007fffff) | 0x3f800000) - 1.0f;
+	v4sf p;
+
+	p = 0.043004958f * t - 0.18748860f;
+	p = p * t + 0.40947030f;
+	p = p * t - 0.70648645f;
+	p = p * t + 1.44149241f;
+	p = p * t + 1.65146709e-5f;
+
+	return e + p;
+}
+
+static inline size_t path_loss_vec_size(int num_stas)
+{
+	return (num_stas + PATH_LOSS_VEC_LEN - 1) & ~(PATH_LOSS_VEC_LEN - 1);
+}
+
+double log_distance_reference_loss(void)
+{
+	/*
+	 * Calculate PL0 with Free-space path loss in decibels
+	 *
+	 * 20 * log10 * (4 * M_PI * d * f / c)
+	 *   d: distance [meter]
+	 *   f: frequency [Hz]
+	 *   c: speed of light in a vacuum [meter/second]
+	 *
+	 * https://en.wikipedia.org/wiki/Free-space_path_loss
+	 */
+	return 20.0 * log10(4.0 * M_PI * 1.0 * FREQ_1CH / SPEED_LIGHT);
+}
+
+/*
+ * Calculate path loss based on a log distance model
+ *
+ * This function returns path loss [dBm].
+ */
+int calc_path_loss_log_distance(void *model_param,
+			  struct station *dst, struct station *src)
+{
+	struct log_distance_model_param *param;
+	double PL, d;
+
+	param = model_param;
+
+	d = sqrt((src->x - dst->x) * (src->x - dst->x) +
+		 (src->y - dst->y) * (src->y - dst->y) +
+		 (src->z - dst->z) * (src->z - dst->z));
+
+	/*
+	 * Calculate signal strength with Log-distance path loss model
+	 * https://en.wikipedia.org/wiki/Log-distance_path_loss_model
+	 */
+	PL = param->PL0 + 10.0 * param->path_loss_exponent * log10(d) +
+		param->Xg;
+
+	return PL;
+}
+
+/*
+ * Load the values of up to four stations.  Without a list of stations the
+ * values are contiguous and padded to full vectors.
+ */
+static inline v4sf load_values(const float *values, const int *dst, int num,
+			       int i)
+{
+	v4sf v = {};
+	int k;
+
+	if (!dst) {
+		memcpy(&v, &values[i], sizeof(v));
+		return v;
+	}
+
+	for (k = 0; k < PATH_LOSS_VEC_LEN && i + k < num; k++)
+		v[k] = values[dst[i + k]];
+	return v;
+}
+
+static inline void load_positions(struct wmediumd *ctx, const int *dst,
+				  int num, int i, v4sf *x, v4sf *y, v4sf *z)
+{
+	*x = load_values(ctx->pos_x, dst, num, i);
+	*y = load_values(ctx->pos_y, dst, num, i);
+	*z = load_values(ctx->pos_z, dst, num, i);
+}
+
+/* log2() of the squared distances from a station to up to four stations */
+static inline v4sf load_log2_dist2(struct wmediumd *ctx, int src,
+				   const int *dst, int num, int i)
+{
+	const v4sf min_d2 = { PATH_LOSS_MIN_DIST2, PATH_LOSS_MIN_DIST2,
+			      PATH_LOSS_MIN_DIST2, PATH_LOSS_MIN_DIST2 };
+	v4sf x, y, z, d2;
+	v4si too_close;
+
+	load_positions(ctx, dst, num, i, &x, &y, &z);
+	x -= ctx->pos_x[src];
+	y -= ctx->pos_y[src];
+	z -= ctx->pos_z[src];
+	d2 = x * x + y * y + z * z;
+
+	too_close = d2 < min_d2;
+	d2 = (v4sf)(((v4si)d2 & ~too_close) | ((v4si)min_d2 & too_close));
+
+	return fast_log2(d2);
+}
+
+/*
+ * Frequency dependent loss of links from a station to up to four stations.
+ * A link runs at the geometric mean of the frequencies of its stations, so
+ * it is the same in both directions.
+ */
+static inline v4sf load_freq_offsets(struct wmediumd *ctx, int src,
+				     const int *dst, int num, int i)
+{
+	if (!ctx->freq_offsets)
+		return (v4sf){};
+	return ctx->freq_offsets[src] +
+		load_values(ctx->freq_offsets, dst, num, i);
+}
+
+/* Frequency dependent loss of a link or of the lowest frequencies for -1 */
+static double link_freq_offset(struct wmediumd *ctx, int src, int dst)
+{
+	float offset_min = 0.0f;
+	int i;
+
+	if (!ctx->freq_offsets)
+		return 0.0;
+	if (src >= 0)
+		return ctx->freq_offsets[src] + ctx->freq_offsets[dst];
+
+	for (i = 0; i < ctx->num_stas; i++)
+		if (i == 0 || ctx->freq_offsets[i] < offset_min)
+			offset_min = ctx->freq_offsets[i];
+	return 2.0 * offset_min;
+}
+
+/*
+ * Same model as calc_path_loss_log_distance(), using
+ * 10 * n * log10(d) = 5 * n * log10(2) * log2(d^2)
+ */
+void calc_path_loss_row_log_distance(struct wmediumd *ctx, int src,
+				     const int *dst, int num,
+				     float *path_loss)
+{
+	struct log_distance_model_param *param = ctx->path_loss_param;
+	float scale = 5.0 * param->path_loss_exponent * log10(2.0);
+	float offset = param->PL0 + param->Xg;
+	v4sf pl;
+	int i;
+
+	for (i = 0; i < num; i += PATH_LOSS_VEC_LEN) {
+		pl = offset + scale * load_log2_dist2(ctx, src, dst, num, i) +
+			load_freq_offsets(ctx, src, dst, num, i);
+		memcpy(&path_loss[i], &pl, sizeof(pl));
+	}
+}
+
+double calc_path_loss_range_log_distance(struct wmediumd *ctx, int src,
+					 int dst, double path_loss)
+{
+	struct log_distance_model_param *param = ctx->path_loss_param;
+
+	if (param->path_loss_exponent <= 0.0)
+		return INFINITY;
+
+	return pow(10.0, (path_loss - param->PL0 - param->Xg -
+			  link_freq_offset(ctx, src, dst)) /
+		   (10.0 * param->path_loss_exponent));
+}
+
+/*
+ * Two-ray ground reflection: free-space path loss up to the crossover
+ * distance 4 * pi * h^2 / lambda, 40 * log10(d) - 20 * log10(h^2) beyond.
+ * The free-space loss is the larger one before the crossover and the
+ * smaller one after, so the model is the maximum of both.
+ */
+void calc_path_loss_row_two_ray_ground(struct wmediumd *ctx, int src,
+				       const int *dst, int num,
+				       float *path_loss)
+{
+	struct two_ray_ground_model_param *param = ctx->path_loss_param;
+	float free_space_scale = 10.0 * log10(2.0);
+	float ground_scale = 20.0 * log10(2.0);
+	float ground_offset = -40.0 * log10(param->antenna_height);
+	float free_space_offset = param->PL0;
+	v4sf l2, free_space, ground, pl;
+	v4si nearer;
+	int i;
+
+	for (i = 0; i < num; i += PATH_LOSS_VEC_LEN) {
+		l2 = load_log2_dist2(ctx, src, dst, num, i);
+		free_space = free_space_offset + free_space_scale * l2 +
+			load_freq_offsets(ctx, src, dst, num, i);
+		ground = ground_offset + ground_scale * l2;
+
+		nearer = free_space > ground;
+		pl = (v4sf)(((v4si)free_space & nearer) |
+			    ((v4si)ground & ~nearer));
+		memcpy(&path_loss[i], &pl, sizeof(pl));
+	}
+}
+
+double calc_path_loss_range_two_ray_ground(struct wmediumd *ctx, int src,
+					   int dst, double path_loss)
+{
+	struct two_ray_ground_model_param *param = ctx->path_loss_param;
+	double free_space, ground;
+
+	free_space = pow(10.0, (path_loss - param->PL0 -
+				link_freq_offset(ctx, src, dst)) / 20.0);
+	ground = pow(10.0, (path_loss +
+			    40.0 * log10(param->antenna_height)) / 40.0);
+
+	return fmin(free_space, ground);
+}
+
+/*
+ * Index of the shadowing of a pair into the table of quantiles, a hash of
+ * the pair and the seed so it does not depend on the direction
+ */
+static inline unsigned int shadowing_index(struct wmediumd *ctx, int a, int b)
+{
+	u64 h = ((u64)min(a, b) << 32 | (u32)(a < b ? b : a)) ^ ctx->seed;
+
+	h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+	h ^= h >> 31;
+
+	return h & (SHADOWING_TABLE_SIZE - 1);
+}
+
+/*
+ * Log-distance path loss with a log-normal shadowing that is fixed for
+ * each pair of stations
+ */
+void calc_path_loss_row_log_normal_shadowing(struct wmediumd *ctx, int src,
+					     const int *dst, int num,
+					     float *path_loss)
+{
+	struct log_normal_shadowing_model_param *param = ctx->path_loss_param;
+	float scale = 5.0 * param->path_loss_exponent * log10(2.0);
+	float offset = param->PL0;
+	v4sf pl, shadowing;
+	int i, k;
+
+	for (i = 0; i < num; i += PATH_LOSS_VEC_LEN) {
+		shadowing = (v4sf){};
+		for (k = 0; k < PATH_LOSS_VEC_LEN && i + k < num; k++)
+			shadowing[k] = param->shadowing[shadowing_index(ctx,
+				src, dst ? dst[i + k] : i + k)];
+
+		pl = offset + scale * load_log2_dist2(ctx, src, dst, num, i) +
+			load_freq_offsets(ctx, src, dst, num, i) + shadowing;
+		memcpy(&path_loss[i], &pl, sizeof(pl));
+	}
+}
+
+double calc_path_loss_range_log_normal_shadowing(struct wmediumd *ctx,
+						 int src, int dst,
+						 double path_loss)
+{
+	struct log_normal_shadowing_model_param *param = ctx->path_loss_param;
+	double shadowing;
+
+	if (param->path_loss_exponent <= 0.0)
+		return INFINITY;
+
+	/* the first entry is the strongest negative shadowing */
+	shadowing = src >= 0 ?
+		param->shadowing[shadowing_index(ctx, src, dst)] :
+		param->shadowing[0];
+
+	return pow(10.0, (path_loss - param->PL0 - shadowing -
+			  link_freq_offset(ctx, src, dst)) /
+		   (10.0 * param->path_loss_exponent));
+}
+
+int init_log_normal_shadowing(struct log_normal_shadowing_model_param *param,
+			      double sigma)
+{
+	double p, lo, hi, x;
+	int i, k;
+
+	param->shadowing = malloc(SHADOWING_TABLE_SIZE * sizeof(float));
+	if (!param->shadowing)
+		return -ENOMEM;
+
+	/* quantiles of the normal distribution at the centers of the entries */
+	for (i = 0; i < SHADOWING_TABLE_SIZE; i++) {
+		p = (i + 0.5) / SHADOWING_TABLE_SIZE;
+		lo = -10.0;
+		hi = 10.0;
+		for (k = 0; k < 64; k++) {
+			x = (lo + hi) / 2.0;
+			if (0.5 * erfc(-x / M_SQRT2) < p)
+				lo = x;
+			else
+				hi = x;
+		}
+		param->shadowing[i] = sigma * (lo + hi) / 2.0;
+	}
+
+	return 0;
+}
+
+/*
+ * State of the SNR matrix recalculation.
+ *
+ * The SNR matrix is double buffered: updates are written into
+ * ctx->snr_matrix_back and published by swapping it with ctx->snr_matrix,
+ * so readers never see a half updated matrix.  After a swap the back
+ * buffer lacks the rows and columns written by the last update; those are
+ * copied over from the front buffer at the start of the next one.  SNRs
+ * set by hand only go into the front buffer and mark their stations, whose
+ * rows and columns are carried over into the next matrix when it is
+ * published.
+ *
+ * Stations are kept in a uniform grid whose cells are as large as the
+ * range beyond which no station can sense another.  Only stations in the
+ * 3x3 cells around a station are evaluated, all others are unreachable.
+ * Cells are hashed into buckets of doubly linked lists by station index,
+ * so the grid is unbounded and a move only relinks one station.  The grid
+ * is two dimensional, heights only count when comparing the distance.
+ *
+ * The loss of the obstacles between a pair is kept until one of the two
+ * stations moves; NAN marks pairs that have to be traced again.
+ */
+struct path_loss_state {
+	struct worker_pool *pool;
+	float *scratch;		/* one path loss row per worker */
+	int *neighbors;		/* one list of reachable stations per worker */
+	float *moved_rows;	/* path loss rows of the moved stations */
+	int *moved;		/* indices of the stations to update */
+	int num_moved;
+	int *stale;		/* indices written by the last update */
+	int num_stale;
+	bool stale_all;		/* back buffer is entirely out of date */
+	bool *is_moved;
+	bool *is_stale;
+	int *snr_set;		/* indices with SNRs set by hand */
+	int num_snr_set;
+	bool *is_snr_set;
+	float *obstacle_loss;	/* by pair, only with obstacles [dB] */
+
+	double range_loss;	/* path loss beyond which stations are unreachable [dB] */
+	double range_margin;	/* of range_loss below the CCA threshold [dB] */
+	double range;		/* maximum distance of reachable stations [m] */
+	double slack;		/* how far the grid may lag behind [m] */
+	double cell_size;	/* 0 if everything is in range */
+	int *grid;		/* first station of each bucket or -1 */
+	unsigned int grid_mask;
+	int *cell_next, *cell_prev;
+	long *cell_x, *cell_y;
+	int *reachable;		/* result of get_reachable_stations_grid() */
+	/* positions and grid while the mobility thread moves stations */
+	pthread_mutex_t grid_lock;
+
+	/* mobility thread */
+	pthread_t mobility_thread;
+	pthread_mutex_t snapshot_lock;
+	pthread_cond_t snapshot_taken;
+	bool snapshot_ready;	/* back buffer holds the next matrix */
+	bool stop;
+
+	/* continuous mobility: position = orig + vel * (min(t, t_end) - t0) */
+	double *orig_x, *orig_y;	/* [m] */
+	double *vel_x, *vel_y;		/* [m/s] */
+	double *t0, *t_end;		/* [s] */
+	double v_max;			/* fastest speed so far [m/s] */
+	double *snr_until;	/* time until which each cached SNR holds [s] */
+	double tolerance;	/* change of path loss within that time [dB] */
+
+	/* kinetic mobility: queue of the next crossing of each moving pair */
+	bool kinetic;
+	struct kinetic_event *events;
+	size_t num_events, events_size;
+	u32 *pair_gen;		/* invalidates queued events of a pair */
+};
+
+struct kinetic_event {
+	double time;		/* [s, CLOCK_MONOTONIC] */
+	int i, j;		/* i < j */
+	u32 gen;
+};
+
+/* Resize an array of num entries, keeping the leading ones */
+static int resize_array(void *array, size_t num, size_t size)
+{
+	void **ptr = array;
+	void *tmp = realloc(*ptr, num * size);
+
+	if (!tmp && num)
+		return -ENOMEM;
+	*ptr = tmp;
+	return 0;
+}
+
+/* Drop the entry of a station from an array of num per-station entries */
+static void remove_entry(void *array, int num, int idx, size_t size)
+{
+	char *p = array;
+
+	memmove(p + idx * size, p + (idx + 1) * size, (num - idx - 1) * size);
+}
+
+/* Drop the row and column of a station from a num x num matrix in place */
+static void remove_pairs(void *matrix, int num, int idx, size_t size)
+{
+	char *p = matrix;
+	int i, j, k = 0;
+
+	for (i = 0; i < num; i++) {
+		for (j = 0; j < num; j++) {
+			if (i == idx || j == idx)
+				continue;
+			memmove(p + k++ * size, p + (num * i + j) * size, size);
+		}
+	}
+}
+
+/* Grow a num x num matrix by a zeroed last row and column */
+static int grow_pairs(void *matrix, int num, size_t size)
+{
+	char *p;
+	int i;
+
+	if (resize_array(matrix, (num + 1) * (num + 1), size))
+		return -ENOMEM;
+
+	p = *(void **)matrix;
+	for (i = num - 1; i >= 0; i--) {
+		memmove(p + (num + 1) * i * size, p + num * i * size,
+			num * size);
+		memset(p + ((num + 1) * i + num) * size, 0, size);
+	}
+	memset(p + (num + 1) * num * size, 0, (num + 1) * size);
+	return 0;
+}
+
+static inline long grid_coord(struct path_loss_state *state, float pos)
+{
+	if (state->cell_size == 0.0)
+		return 0;
+	return (long)floor(pos / state->cell_size);
+}
+
+static inline unsigned int grid_bucket(struct path_loss_state *state,
+				       long cx, long cy)
+{
+	u64 h = (u64)cx * 0x9e3779b97f4a7c15ULL ^
+		(u64)cy * 0xc2b2ae3d27d4eb4fULL;
+
+	return (h ^ (h >> 32)) & state->grid_mask;
+}
+
+static void grid_unlink(struct path_loss_state *state, int idx)
+{
+	int next = state->cell_next[idx], prev = state->cell_prev[idx];
+
+	if (prev >= 0)
+		state->cell_next[prev] = next;
+	else
+		state->grid[grid_bucket(state, state->cell_x[idx],
+					state->cell_y[idx])] = next;
+	if (next >= 0)
+		state->cell_prev[next] = prev;
+}
+
+static void grid_link(struct path_loss_state *state, int idx, long cx,
+		      long cy)
+{
+	unsigned int bucket = grid_bucket(state, cx, cy);
+	int head = state->grid[bucket];
+
+	state->cell_x[idx] = cx;
+	state->cell_y[idx] = cy;
+	state->cell_prev[idx] = -1;
+	state->cell_next[idx] = head;
+	if (head >= 0)
+		state->cell_prev[head] = idx;
+	state->grid[bucket] = idx;
+}
+
+/* Move a station to the cell of its current position */
+static void grid_update(struct wmediumd *ctx, int idx)
+{
+	struct path_loss_state *state = ctx->path_loss_state;
+	long cx = grid_coord(state, ctx->pos_x[idx]);
+	long cy = grid_coord(state, ctx->pos_y[idx]);
+
+	if (cx == state->cell_x[idx] && cy == state->cell_y[idx])
+		return;
+
+	grid_unlink(state, idx);
+	grid_link(state, idx, cx, cy);
+}
+
+/*
+ * Collect the stations within range of a station
+ *
+ * Returns the number of stations stored into dst.
+ */
+static int grid_neighbors(struct wmediumd *ctx, int src, int *dst)
+{
+	struct path_loss_state *state = ctx->path_loss_state;
+	double radius = state->range + state->slack;
+	double range2 = radius * radius;
+	long cx, cy, span = state->cell_size == 0.0 ? 0 : 1;
+	float dx, dy, dz;
+	int i, num = 0;
+
+	for (cx = state->cell_x[src] - span;
+	     cx <= state->cell_x[src] + span; cx++) {
+		for (cy = state->cell_y[src] - span;
+		     cy <= state->cell_y[src] + span; cy++) {
+			i = state->grid[grid_bucket(state, cx, cy)];
+			for (; i >= 0; i = state->cell_next[i]) {
+				if (i == src || state->cell_x[i] != cx ||
+				    state->cell_y[i] != cy)
+					continue;
+				dx = ctx->pos_x[i] - ctx->pos_x[src];
+				dy = ctx->pos_y[i] - ctx->pos_y[src];
+				dz = ctx->pos_z[i] - ctx->pos_z[src];
+				if (dx * dx + dy * dy + dz * dz > range2)
+					continue;
+				dst[num++] = i;
+			}
+		}
+	}
+
+	return num;
+}
+
+const int *get_reachable_stations_grid(struct wmediumd *ctx,
+				       struct station *src, int *num)
+{
+	struct path_loss_state *state = ctx->path_loss_state;
+
+	pthread_mutex_lock(&state->grid_lock);
+	*num = grid_neighbors(ctx, src->index, state->reachable);
+	pthread_mutex_unlock(&state->grid_lock);
+	return state->reachable;
+}
+
+static inline int path_loss_to_snr(struct wmediumd *ctx, int src,
+				   float path_loss)
+{
+	if (path_loss >= PATH_LOSS_UNREACHABLE)
+		return SNR_UNREACHABLE;
+	return ctx->tx_powers[src] - (int)path_loss - NOISE_LEVEL;
+}
+
+/*
+ * Add the loss of the obstacles between a station and its neighbors,
+ * tracing only the pairs of which a station moved.  Pairs are traced from
+ * the lower index so both directions agree, and only until they are lost
+ * beyond the range.
+ */
+static void add_obstacle_loss(struct wmediumd *ctx, int start,
+			      const int *neighbors, int num, float *compact)
+{
+	struct path_loss_state *state = ctx->path_loss_state;
+	float *cache = state->obstacle_loss + ctx->num_stas * start;
+	float limit, p[2][3];
+	int i, end;
+
+	if (state->is_moved[start])
+		for (i = 0; i < ctx->num_stas; i++)
+			cache[i] = NAN;
+
+	p[0][0] = ctx->pos_x[start];
+	p[0][1] = ctx->pos_y[start];
+	p[0][2] = ctx->pos_z[start];
+	for (i = 0; i < num; i++) {
+		end = neighbors[i];
+		limit = state->range_loss - compact[i];
+		if (isnan(cache[end]) || state->is_moved[end]) {
+			p[1][0] = ctx->pos_x[end];
+			p[1][1] = ctx->pos_y[end];
+			p[1][2] = ctx->pos_z[end];
+			cache[end] = obstacles_loss(ctx->obstacles,
+						    p[start > end],
+						    p[start < end], limit);
+		}
+		if (cache[end] >= limit)
+			compact[i] = PATH_LOSS_UNREACHABLE;
+		else
+			compact[i] += cache[end];
+	}
+}
+
+/*
+ * Index of the pseudo-angles of directions in the frames of antennas
+ * oriented at (c, s), see struct antenna_pattern
+ */
+static inline v4si antenna_index(v4sf x, v4sf y, v4sf c, v4sf s)
+{
+	const v4si abs_mask = { 0x7fffffff, 0x7fffffff, 0x7fffffff,
+				0x7fffffff };
+	const v4sf one = { 1.0f, 1.0f, 1.0f, 1.0f };
+	v4sf rx = x * c + y * s, ry = y * c - x * s, norm, p;
+	v4si zero, neg_x, neg_y;
+
+	norm = (v4sf)((v4si)rx & abs_mask) + (v4sf)((v4si)ry & abs_mask);
+	zero = norm == 0.0f;
+	norm = (v4sf)(((v4si)norm & ~zero) | ((v4si)one & zero));
+
+	p = ry / norm;
+	neg_x = rx < 0.0f;
+	neg_y = ry < 0.0f;
+	p = (v4sf)(((v4si)(2.0f - p) & neg_x) |
+		   ((v4si)(4.0f + p) & ~neg_x & neg_y) |
+		   ((v4si)p & ~neg_x & ~neg_y));
+
+	return __builtin_convertvector(p * (ANTENNA_TABLE_SIZE / 4), v4si) &
+		(ANTENNA_TABLE_SIZE - 1);
+}
+
+static const float isotropic_gain[ANTENNA_TABLE_SIZE];
+
+static inline const float *antenna_table(const struct station_antenna *a)
+{
+	return a->pattern ? a->pattern->gain : isotropic_gain;
+}
+
+/*
+ * Subtract the antenna gains of a station and its neighbors towards each
+ * other.  Both directions of a pair see the same sum of gains.
+ */
+static void add_antenna_gain(struct wmediumd *ctx, int start,
+			     const int *neighbors, int num, float *compact)
+{
+	const struct station_antenna *antenna = ctx->sta_antennas, *a;
+	const float *tx_gain = antenna_table(&antenna[start]);
+	v4sf x0, y0, c0, s0, x, y, z, c, s;
+	v4si tx_idx, rx_idx;
+	int i, k, end;
+
+	x0 = (v4sf){} + ctx->pos_x[start];
+	y0 = (v4sf){} + ctx->pos_y[start];
+	c0 = (v4sf){} + antenna[start].cos;
+	s0 = (v4sf){} + antenna[start].sin;
+
+	for (i = 0; i < num; i += PATH_LOSS_VEC_LEN) {
+		load_positions(ctx, neighbors, num, i, &x, &y, &z);
+		c = s = (v4sf){};
+		for (k = 0; k < PATH_LOSS_VEC_LEN && i + k < num; k++) {
+			a = &antenna[neighbors[i + k]];
+			c[k] = a->cos;
+			s[k] = a->sin;
+		}
+
+		x -= x0;
+		y -= y0;
+		tx_idx = antenna_index(x, y, c0, s0);
+		rx_idx = antenna_index(-x, -y, c, s);
+
+		for (k = 0; k < PATH_LOSS_VEC_LEN && i + k < num; k++) {
+			end = neighbors[i + k];
+			compact[i + k] -= tx_gain[tx_idx[k]] +
+				antenna_table(&antenna[end])[rx_idx[k]];
+		}
+	}
+}
+
+/*
+ * Calculate the path loss from a station to all stations, leaving
+ * PATH_LOSS_UNREACHABLE for the stations out of range
+ */
+static void calc_path_loss_row(struct wmediumd *ctx, int start, int worker,
+			       float *path_loss)
+{
+	struct path_loss_state *state = ctx->path_loss_state;
+	float *compact = state->scratch +
+		worker * path_loss_vec_size(ctx->num_stas);
+	int *neighbors = state->neighbors + worker * ctx->num_stas;
+	int i, num;
+
+	num = grid_neighbors(ctx, start, neighbors);
+	ctx->calc_path_loss_row(ctx, start, neighbors, num, compact);
+	if (ctx->sta_antennas)
+		add_antenna_gain(ctx, start, neighbors, num, compact);
+	if (ctx->obstacles)
+		add_obstacle_loss(ctx, start, neighbors, num, compact);
+
+	for (i = 0; i < ctx->num_stas; i++)
+		path_loss[i] = PATH_LOSS_UNREACHABLE;
+	for (i = 0; i < num; i++)
+		path_loss[neighbors[i]] = compact[i];
+}
+
+static void write_snr_row(struct wmediumd *ctx, int start,
+			  const float *path_loss)
+{
+	int *row = ctx->snr_matrix_back + ctx->num_stas * start;
+	int end;
+
+	for (end = 0; end < ctx->num_stas; end++)
+		row[end] = path_loss_to_snr(ctx, start, path_loss[end]);
+	row[start] = ctx->snr_matrix[ctx->num_stas * start + start];
+}
+
+/* Recalculate the rows of the back buffer owned by a worker */
+static void recalc_rows(void *arg, int worker, int workers)
+{
+	struct wmediumd *ctx = arg;
+	struct path_loss_state *state = ctx->path_loss_state;
+	float *path_loss = state->moved_rows +
+		worker * path_loss_vec_size(ctx->num_stas);
+	int start, begin, last;
+
+	worker_range(ctx->num_stas, worker, workers, &begin, &last);
+	for (start = begin; start < last; start++) {
+		calc_path_loss_row(ctx, start, worker, path_loss);
+		write_snr_row(ctx, start, path_loss);
+	}
+}
+
+/* Recalculate the rows of the moved stations owned by a worker */
+static void recalc_moved_rows(void *arg, int worker, int workers)
+{
+	struct wmediumd *ctx = arg;
+	struct path_loss_state *state = ctx->path_loss_state;
+	size_t len = path_loss_vec_size(ctx->num_stas);
+	float *path_loss;
+	int i, begin, last;
+
+	worker_range(state->num_moved, worker, workers, &begin, &last);
+	for (i = begin; i < last; i++) {
+		path_loss = state->moved_rows + i * len;
+		calc_path_loss_row(ctx, state->moved[i], worker, path_loss);
+		write_snr_row(ctx, state->moved[i], path_loss);
+	}
+}
+
+/*
+ * Bring the other rows owned by a worker up to date and write the columns
+ * of the moved stations, relying on the models being symmetric.
+ */
+static void recalc_moved_columns(void *arg, int worker, int workers)
+{
+	struct wmediumd *ctx = arg;
+	struct path_loss_state *state = ctx->path_loss_state;
+	size_t len = path_loss_vec_size(ctx->num_stas);
+	int *front = ctx->snr_matrix, *back = ctx->snr_matrix_back;
+	int *row_front, *row_back;
+	int i, end, begin, last;
+
+	worker_range(ctx->num_stas, worker, workers, &begin, &last);
+	for (end = begin; end < last; end++) {
+		if (state->is_moved[end])
+			continue;
+
+		row_front = front + ctx->num_stas * end;
+		row_back = back + ctx->num_stas * end;
+		if (state->stale_all || state->is_stale[end]) {
+			memcpy(row_back, row_front,
+			       ctx->num_stas * sizeof(*row_back));
+		} else {
+			for (i = 0; i < state->num_stale; i++)
+				row_back[state->stale[i]] =
+					row_front[state->stale[i]];
+		}
+
+		for (i = 0; i < state->num_moved; i++)
+			row_back[state->moved[i]] = path_loss_to_snr(ctx, end,
+				state->moved_rows[i * len + end]);
+
+		if (!ctx->obstacles)
+			continue;
+		for (i = 0; i < state->num_moved; i++)
+			state->obstacle_loss[ctx->num_stas * end +
+					     state->moved[i]] =
+				state->obstacle_loss[ctx->num_stas *
+						     state->moved[i] + end];
+	}
+}
+
+static void publish_snr_matrix(struct wmediumd *ctx)
+{
+	struct path_loss_state *state = ctx->path_loss_state;
+	int *front = ctx->snr_matrix, *back = ctx->snr_matrix_back;
+	int i, s, end, n = ctx->num_stas;
+
+	/* keep SNRs set by hand unless the stations moved since */
+	for (i = 0; i < state->num_snr_set; i++) {
+		s = state->snr_set[i];
+		state->is_snr_set[s] = false;
+		if (state->stale_all || state->is_moved[s])
+			continue;
+		for (end = 0; end < n; end++) {
+			if (state->is_moved[end])
+				continue;
+			back[n * s + end] = front[n * s + end];
+			back[n * end + s] = front[n * end + s];
+		}
+	}
+	state->num_snr_set = 0;
+
+	__atomic_store_n(&ctx->snr_matrix, ctx->snr_matrix_back,
+			 __ATOMIC_RELEASE);
+	ctx->snr_matrix_back = front;
+	__atomic_add_fetch(&ctx->link_epoch, 1, __ATOMIC_RELEASE);
+}
+
+/* Recalculate the whole back buffer */
+static void recalc_path_loss(struct wmediumd *ctx)
+{
+	struct path_loss_state *state = ctx->path_loss_state;
+	int start;
+
+	worker_pool_run(state->pool, recalc_rows, ctx);
+
+	for (start = 0; start < ctx->num_stas; start++)
+		ctx->sta_array[start]->moved = false;
+	state->stale_all = true;
+}
+
+/*
+ * Recalculate only the rows and columns of stations that have moved
+ * since the last update.
+ *
+ * Returns whether the back buffer holds a new matrix to publish.
+ */
+static bool recalc_path_loss_moved(struct wmediumd *ctx)
+{
+	struct path_loss_state *state = ctx->path_loss_state;
+	int i, start;
+
+	for (i = 0; i < state->num_stale; i++)
+		state->is_stale[state->stale[i]] = false;
+	state->num_stale = state->num_moved;
+	memcpy(state->stale, state->moved,
+	       state->num_moved * sizeof(*state->stale));
+	for (i = 0; i < state->num_stale; i++) {
+		state->is_stale[state->stale[i]] = true;
+		state->is_moved[state->stale[i]] = false;
+	}
+
+	state->num_moved = 0;
+	for (start = 0; start < ctx->num_stas; start++) {
+		if (!ctx->sta_array[start]->moved)
+			continue;
+		state->moved[state->num_moved++] = start;
+		state->is_moved[start] = true;
+		ctx->sta_array[start]->moved = false;
+	}
+
+	/* moving most of the stations is cheaper as a full recalculation */
+	if (state->num_moved > ctx->num_stas / 2) {
+		recalc_path_loss(ctx);
+		return true;
+	}
+	if (!state->num_moved && !state->num_stale && !state->stale_all)
+		return false;
+
+	worker_pool_run(state->pool, recalc_moved_rows, ctx);
+	worker_pool_run(state->pool, recalc_moved_columns, ctx);
+	state->stale_all = false;
+	return true;
+}
+
+static int path_loss_default_threads(struct wmediumd *ctx)
+{
+	long cpus;
+
+	if (ctx->num_stas < PATH_LOSS_PARALLEL_MIN_STAS)
+		return 1;
+
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cpus < 1)
+		return 1;
+	return min(cpus, PATH_LOSS_MAX_THREADS);
+}
+
+/*
+ * Set up the grid with cells as large as the range plus the distance by
+ * which the positions in the grid may lag behind
+ */
+static int init_grid(struct wmediumd *ctx, double slack)
+{
+	struct path_loss_state *state = ctx->path_loss_state;
+	unsigned int buckets = 16;
+	double radius = state->range + slack;
+	int i;
+
+	state->slack = slack;
+	if (isfinite(radius))
+		state->cell_size = radius > 1.0 ? radius : 1.0;
+	else
+		state->cell_size = 0.0;
+
+	while (buckets < (unsigned int)ctx->num_stas)
+		buckets <<= 1;
+	state->grid_mask = buckets - 1;
+
+	/* stations may have been added since the last call */
+	if (resize_array(&state->grid, buckets, sizeof(int)) ||
+	    resize_array(&state->cell_next, ctx->num_stas, sizeof(int)) ||
+	    resize_array(&state->cell_prev, ctx->num_stas, sizeof(int)) ||
+	    resize_array(&state->cell_x, ctx->num_stas, sizeof(long)) ||
+	    resize_array(&state->cell_y, ctx->num_stas, sizeof(long)) ||
+	    resize_array(&state->reachable, ctx->num_stas, sizeof(int)))
+		return -ENOMEM;
+
+	memset(state->grid, 0xff, buckets * sizeof(int));
+	for (i = 0; i < ctx->num_stas; i++)
+		grid_link(state, i, grid_coord(state, ctx->pos_x[i]),
+			  grid_coord(state, ctx->pos_y[i]));
+
+	return 0;
+}
+
+/*
+ * Get the path loss at which the strongest station falls range_margin
+ * below the CCA threshold, between the antennas with the highest gain
+ */
+static double max_range_loss(struct wmediumd *ctx, double range_margin)
+{
+	int i, tx_max = INT32_MIN;
+	double gain, gain_max = 0.0;
+
+	for (i = 0; i < ctx->num_stas; i++)
+		tx_max = tx_max > ctx->tx_powers[i] ? tx_max :
+			ctx->tx_powers[i];
+
+	for (i = 0; ctx->sta_antennas && i < ctx->num_stas; i++) {
+		if (!ctx->sta_antennas[i].pattern)
+			continue;
+		gain = ctx->sta_antennas[i].pattern->max_gain;
+		if (gain > gain_max)
+			gain_max = gain;
+	}
+
+	return tx_max - CCA_THRESHOLD + range_margin + 2.0 * gain_max;
+}
+
+int init_path_loss(struct wmediumd *ctx, int threads, double range_margin)
+{
+	size_t len = path_loss_vec_size(ctx->num_stas);
+	struct path_loss_state *state;
+	struct station *station;
+	int workers, rows, i;
+
+	if (threads <= 0)
+		threads = path_loss_default_threads(ctx);
+
+	ctx->pos_x = calloc(len, sizeof(float));
+	ctx->pos_y = calloc(len, sizeof(float));
+	ctx->pos_z = calloc(len, sizeof(float));
+	ctx->tx_powers = calloc(len, sizeof(int));
+	ctx->freq_offsets = NULL;
+	ctx->snr_matrix_back = calloc(ctx->num_stas * ctx->num_stas,
+				      sizeof(int));
+	state = calloc(1, sizeof(*state));
+	if (!ctx->pos_x || !ctx->pos_y || !ctx->pos_z || !ctx->tx_powers ||
+	    !ctx->snr_matrix_back || !state)
+		return -ENOMEM;
+	ctx->path_loss_state = state;
+	pthread_mutex_init(&state->grid_lock, NULL);
+
+	state->pool = worker_pool_create(threads);
+	if (!state->pool)
+		return -ENOMEM;
+	workers = worker_pool_size(state->pool);
+
+	/* full recalculations use one row of moved_rows per worker */
+	rows = ctx->num_stas / 2 > workers ? ctx->num_stas / 2 : workers;
+	state->scratch = calloc(workers * len, sizeof(float));
+	state->neighbors = calloc(workers * ctx->num_stas, sizeof(int));
+	state->moved_rows = calloc(rows * len, sizeof(float));
+	state->moved = calloc(ctx->num_stas, sizeof(int));
+	state->stale = calloc(ctx->num_stas, sizeof(int));
+	state->is_moved = calloc(ctx->num_stas, sizeof(bool));
+	state->is_stale = calloc(ctx->num_stas, sizeof(bool));
+	state->snr_set = calloc(ctx->num_stas, sizeof(int));
+	state->is_snr_set = calloc(ctx->num_stas, sizeof(bool));
+	if (!state->scratch || !state->neighbors || !state->moved_rows ||
+	    !state->moved || !state->stale || !state->is_moved ||
+	    !state->is_stale || !state->snr_set || !state->is_snr_set)
+		return -ENOMEM;
+
+	if (ctx->obstacles) {
+		state->obstacle_loss = malloc(ctx->num_stas * ctx->num_stas *
+					      sizeof(float));
+		if (!state->obstacle_loss)
+			return -ENOMEM;
+		for (i = 0; i < ctx->num_stas * ctx->num_stas; i++)
+			state->obstacle_loss[i] = NAN;
+	}
+
+	list_for_each_entry(station, &ctx->stations, list) {
+		if (station->freq <= 0 || station->freq * 1e6 == FREQ_1CH ||
+		    ctx->freq_offsets)
+			continue;
+		ctx->freq_offsets = calloc(len, sizeof(float));
+		if (!ctx->freq_offsets)
+			return -ENOMEM;
+	}
+
+	list_for_each_entry(station, &ctx->stations, list) {
+		if (ctx->freq_offsets && station->freq > 0)
+			ctx->freq_offsets[station->index] =
+				10.0 * log10(station->freq * 1e6 / FREQ_1CH);
+		ctx->pos_x[station->index] = station->x;
+		ctx->pos_y[station->index] = station->y;
+		ctx->pos_z[station->index] = station->z;
+		ctx->tx_powers[station->index] = station->tx_power;
+	}
+
+	state->range_margin = range_margin;
+	state->range_loss = max_range_loss(ctx, range_margin);
+	state->range = ctx->calc_path_loss_range(ctx, -1, -1,
+						 state->range_loss);
+	if (isfinite(state->range))
+		w_logf(ctx, LOG_INFO,
+		       "Stations further apart than %.1f m are unreachable\n",
+		       state->range);
+	if (init_grid(ctx, 0.0))
+		return -ENOMEM;
+
+	if (workers > 1)
+		w_logf(ctx, LOG_INFO,
+		       "Recalculating path loss with %d threads\n", workers);
+
+	recalc_path_loss(ctx);
+	publish_snr_matrix(ctx);
+
+	return 0;
+}
+
+static double timespec_to_sec(const struct timespec *t)
+{
+	return t->tv_sec + t->tv_nsec / 1000000000.0;
+}
+
+static void position_at(struct path_loss_state *state, int idx, double t,
+			double *x, double *y)
+{
+	if (t > state->t_end[idx])
+		t = state->t_end[idx];
+	*x = state->orig_x[idx] + state->vel_x[idx] * (t - state->t0[idx]);
+	*y = state->orig_y[idx] + state->vel_y[idx] * (t - state->t0[idx]);
+}
+
+static inline double velocity_x(struct path_loss_state *state, int idx,
+				double t)
+{
+	return t < state->t_end[idx] ? state->vel_x[idx] : 0.0;
+}
+
+static inline double velocity_y(struct path_loss_state *state, int idx,
+				double t)
+{
+	return t < state->t_end[idx] ? state->vel_y[idx] : 0.0;
+}
+
+static inline bool above_cca(int snr)
+{
+	return snr + NOISE_LEVEL >= CCA_THRESHOLD;
+}
+
+/*
+ * Store the SNRs of a pair of stations in both directions.  The CCA
+ * neighbour sets only go stale when a link crosses CCA_THRESHOLD.
+ */
+static void set_pair_snr(struct wmediumd *ctx, int i, int j, int snr_ij,
+			 int snr_ji)
+{
+	int *snr = ctx->snr_matrix;
+	int ij = ctx->num_stas * i + j, ji = ctx->num_stas * j + i;
+	bool crossed = above_cca(snr[ij]) != above_cca(snr_ij) ||
+		       above_cca(snr[ji]) != above_cca(snr_ji);
+
+	snr[ij] = snr_ij;
+	snr[ji] = snr_ji;
+	if (crossed)
+		__atomic_add_fetch(&ctx->link_epoch, 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Calculate the SNR of a pair of stations at a time and how long it stays
+ * within the tolerance.  The distance changes at most with the relative
+ * speed, so the SNR holds until the distance leaves the interval in which
+ * the path loss stays within the tolerance, or crosses the range.
+ */
+static void update_link_continuous(struct wmediumd *ctx, int i, int j,
+				   double now)
+{
+	struct path_loss_state *state = ctx->path_loss_state;
+	float path_loss[PATH_LOSS_VEC_LEN];
+	double xi, yi, xj, yj, dz, d, vx, vy, v, lo, hi, margin;
+	int snr_ij, snr_ji;
+
+	position_at(state, i, now, &xi, &yi);
+	position_at(state, j, now, &xj, &yj);
+	ctx->pos_x[i] = xi;
+	ctx->pos_y[i] = yi;
+	ctx->pos_x[j] = xj;
+	ctx->pos_y[j] = yj;
+
+	dz = ctx->pos_z[i] - ctx->pos_z[j];
+	d = sqrt((xi - xj) * (xi - xj) + (yi - yj) * (yi - yj) + dz * dz);
+	vx = velocity_x(state, i, now) - velocity_x(state, j, now);
+	vy = velocity_y(state, i, now) - velocity_y(state, j, now);
+	v = sqrt(vx * vx + vy * vy);
+
+	if (d > state->range) {
+		snr_ij = snr_ji = SNR_UNREACHABLE;
+		margin = d - state->range;
+	} else {
+		ctx->calc_path_loss_row(ctx, i, &j, 1, path_loss);
+		snr_ij = path_loss_to_snr(ctx, i, path_loss[0]);
+		snr_ji = path_loss_to_snr(ctx, j, path_loss[0]);
+
+		lo = ctx->calc_path_loss_range(ctx, i, j,
+			path_loss[0] - state->tolerance);
+		hi = ctx->calc_path_loss_range(ctx, i, j,
+			path_loss[0] + state->tolerance);
+		margin = fmin(fmin(d - lo, hi - d), state->range - d);
+		if (margin < 0.0)
+			margin = 0.0;
+	}
+
+	set_pair_snr(ctx, i, j, snr_ij, snr_ji);
+	state->snr_until[ctx->num_stas * i + j] =
+	state->snr_until[ctx->num_stas * j + i] =
+		v > 0.0 ? now + margin / v : INFINITY;
+}
+
+static int kinetic_push(struct path_loss_state *state,
+			struct kinetic_event *ev)
+{
+	struct kinetic_event *heap, tmp;
+	size_t i, parent;
+
+	if (state->num_events == state->events_size) {
+		size_t size = state->events_size ? state->events_size * 2 : 64;
+
+		heap = realloc(state->events, size * sizeof(*heap));
+		if (!heap)
+			return -ENOMEM;
+		state->events = heap;
+		state->events_size = size;
+	}
+
+	heap = state->events;
+	i = state->num_events++;
+	heap[i] = *ev;
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (heap[parent].time <= heap[i].time)
+			break;
+		tmp = heap[i];
+		heap[i] = heap[parent];
+		heap[parent] = tmp;
+		i = parent;
+	}
+
+	return 0;
+}
+
+static void kinetic_sift_down(struct path_loss_state *state, size_t i)
+{
+	struct kinetic_event *heap = state->events, tmp;
+	size_t child;
+
+	while ((child = 2 * i + 1) < state->num_events) {
+		if (child + 1 < state->num_events &&
+		    heap[child + 1].time < heap[child].time)
+			child++;
+		if (heap[i].time <= heap[child].time)
+			break;
+		tmp = heap[i];
+		heap[i] = heap[child];
+		heap[child] = tmp;
+		i = child;
+	}
+}
+
+static void kinetic_pop(struct path_loss_state *state,
+			struct kinetic_event *ev)
+{
+	*ev = state->events[0];
+	state->events[0] = state->events[--state->num_events];
+	kinetic_sift_down(state, 0);
+}
+
+/*
+ * Earliest time after 0 at which |p + v * t| = dist, INFINITY if never.
+ * Stations only move horizontally, pz is the constant height difference.
+ */
+static double crossing_time(double px, double py, double pz, double vx,
+			    double vy, double dist)
+{
+	double a = vx * vx + vy * vy;
+	double b = 2.0 * (px * vx + py * vy);
+	double c = px * px + py * py + pz * pz - dist * dist;
+	double disc = b * b - 4.0 * a * c, root;
+
+	if (a == 0.0 || disc < 0.0)
+		return INFINITY;
+
+	root = sqrt(disc);
+	if ((-b - root) / (2.0 * a) > 0.0)
+		return (-b - root) / (2.0 * a);
+	if ((-b + root) / (2.0 * a) > 0.0)
+		return (-b + root) / (2.0 * a);
+	return INFINITY;
+}
+
+/*
+ * Evaluate the SNR of a pair and queue the next time its path loss
+ * crosses a multiple of the tolerance or the range.  A change of the
+ * velocities at the end of a trajectory is a crossing as well.
+ */
+static int kinetic_update_pair(struct wmediumd *ctx, int i, int j,
+			       double now)
+{
+	struct path_loss_state *state = ctx->path_loss_state;
+	struct kinetic_event ev;
+	float path_loss[PATH_LOSS_VEC_LEN];
+	double xi, yi, xj, yj, px, py, pz, vx, vy, d, level, lo, hi, t;
+	int snr_ij, snr_ji;
+
+	position_at(state, i, now, &xi, &yi);
+	position_at(state, j, now, &xj, &yj);
+	ctx->pos_x[i] = xi;
+	ctx->pos_y[i] = yi;
+	ctx->pos_x[j] = xj;
+	ctx->pos_y[j] = yj;
+
+	px = xi - xj;
+	py = yi - yj;
+	pz = ctx->pos_z[i] - ctx->pos_z[j];
+	vx = velocity_x(state, i, now) - velocity_x(state, j, now);
+	vy = velocity_y(state, i, now) - velocity_y(state, j, now);
+	d = sqrt(px * px + py * py + pz * pz);
+
+	if (d > state->range) {
+		snr_ij = snr_ji = SNR_UNREACHABLE;
+		t = crossing_time(px, py, pz, vx, vy, state->range);
+	} else {
+		ctx->calc_path_loss_row(ctx, i, &j, 1, path_loss);
+		snr_ij = path_loss_to_snr(ctx, i, path_loss[0]);
+		snr_ji = path_loss_to_snr(ctx, j, path_loss[0]);
+
+		level = floor(path_loss[0] / state->tolerance) *
+			state->tolerance;
+		lo = ctx->calc_path_loss_range(ctx, i, j, level);
+		hi = fmin(ctx->calc_path_loss_range(ctx, i, j,
+			level + state->tolerance), state->range);
+
+		/*
+		 * The row kernel only approximates the path loss, so right
+		 * after a crossing the exact distance may still lie on the
+		 * other side of the level it rounds to.  Move on to the next
+		 * level in the direction of motion, or the crossing towards
+		 * it would be missed.
+		 */
+		if (d < lo && px * vx + py * vy < 0.0) {
+			hi = lo;
+			lo = ctx->calc_path_loss_range(ctx, i, j,
+				level - state->tolerance);
+		} else if (d > hi && hi < state->range &&
+			   px * vx + py * vy > 0.0) {
+			lo = hi;
+			hi = fmin(ctx->calc_path_loss_range(ctx, i, j,
+				level + 2 * state->tolerance), state->range);
+		}
+
+		t = fmin(crossing_time(px, py, pz, vx, vy, lo),
+			 crossing_time(px, py, pz, vx, vy, hi));
+	}
+
+	set_pair_snr(ctx, i, j, snr_ij, snr_ji);
+
+	ev.time = now + t;
+	if (now < state->t_end[i] && state->t_end[i] < ev.time)
+		ev.time = state->t_end[i];
+	if (now < state->t_end[j] && state->t_end[j] < ev.time)
+		ev.time = state->t_end[j];
+	if (!isfinite(ev.time))
+		return 0;
+
+	/* do not spin on a boundary because of rounding */
+	if (ev.time < now + KINETIC_MIN_INTERVAL)
+		ev.time = now + KINETIC_MIN_INTERVAL;
+	ev.i = i;
+	ev.j = j;
+	ev.gen = ++state->pair_gen[ctx->num_stas * i + j];
+	return kinetic_push(state, &ev);
+}
+
+/* Evaluate all pairs whose crossing is due */
+static void kinetic_advance(struct wmediumd *ctx, double now)
+{
+	struct path_loss_state *state = ctx->path_loss_state;
+	struct kinetic_event ev;
+
+	while (state->num_events && state->events[0].time <= now) {
+		kinetic_pop(state, &ev);
+		if (ev.gen != state->pair_gen[ctx->num_stas * ev.i + ev.j])
+			continue;
+		if (kinetic_update_pair(ctx, ev.i, ev.j, now))
+			w_flogf(ctx, LOG_ERR, stderr,
+				"Out of memory(kinetic_mobility)\n");
+	}
+}
+
+/* Queue the crossings of all pairs of a station that move */
+static int kinetic_schedule_station(struct wmediumd *ctx, int idx,
+				    double now)
+{
+	int i, ret;
+
+	for (i = 0; i < ctx->num_stas; i++) {
+		if (i == idx)
+			continue;
+		ret = kinetic_update_pair(ctx, min(i, idx), i < idx ? idx : i,
+					  now);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+int get_link_snr_continuous(struct wmediumd *ctx, struct station *sender,
+			    struct station *receiver)
+{
+	struct path_loss_state *state = ctx->path_loss_state;
+	int idx = ctx->num_stas * sender->index + receiver->index;
+	struct timespec now;
+	double t;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	t = timespec_to_sec(&now);
+	if (state->kinetic) {
+		kinetic_advance(ctx, t);
+		return ctx->snr_matrix[idx];
+	}
+	if (t >= state->snr_until[idx])
+		update_link_continuous(ctx, sender->index, receiver->index, t);
+
+	return ctx->snr_matrix[idx];
+}
+
+/*
+ * Refresh the positions of the stations and their cells in the grid every
+ * MOVE_INTERVAL.  The grid is searched with a slack covering how far two
+ * stations can move towards each other in between.
+ */
+void move_stations_continuous(struct wmediumd *ctx)
+{
+	struct path_loss_state *state = ctx->path_loss_state;
+	struct station *station;
+	struct timespec now;
+	double t;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (state->kinetic)
+		kinetic_advance(ctx, timespec_to_sec(&now));
+	if (!timespec_before(&ctx->next_move, &now))
+		return;
+
+	t = timespec_to_sec(&now);
+	list_for_each_entry(station, &ctx->stations, list) {
+		if (state->vel_x[station->index] == 0.0 &&
+		    state->vel_y[station->index] == 0.0)
+			continue;
+		position_at(state, station->index, t, &station->x,
+			    &station->y);
+		ctx->pos_x[station->index] = station->x;
+		ctx->pos_y[station->index] = station->y;
+		grid_update(ctx, station->index);
+	}
+
+	ctx->next_move = now;
+	ctx->next_move.tv_sec += MOVE_INTERVAL;
+	__atomic_add_fetch(&ctx->link_epoch, 1, __ATOMIC_RELEASE);
+}
+
+void path_loss_get_position(struct wmediumd *ctx, int idx, double t,
+			    double *x, double *y)
+{
+	position_at(ctx->path_loss_state, idx, t, x, y);
+}
+
+int path_loss_set_trajectory(struct wmediumd *ctx, int idx, double t,
+			     double x, double y, double vx, double vy,
+			     double t_end)
+{
+	struct path_loss_state *state = ctx->path_loss_state;
+	double v = sqrt(vx * vx + vy * vy);
+	int i, ret;
+
+	state->orig_x[idx] = x;
+	state->orig_y[idx] = y;
+	state->vel_x[idx] = vx;
+	state->vel_y[idx] = vy;
+	state->t0[idx] = t;
+	state->t_end[idx] = t_end;
+
+	for (i = 0; i < ctx->num_stas; i++) {
+		state->snr_until[ctx->num_stas * idx + i] = 0.0;
+		state->snr_until[ctx->num_stas * i + idx] = 0.0;
+	}
+	if (state->kinetic) {
+		/* drop the queued crossings of the station */
+		for (i = 0; i < ctx->num_stas; i++)
+			state->pair_gen[ctx->num_stas * min(i, idx) +
+					(i < idx ? idx : i)]++;
+		ret = kinetic_schedule_station(ctx, idx, t);
+		if (ret)
+			return ret;
+	}
+
+	ctx->pos_x[idx] = x;
+	ctx->pos_y[idx] = y;
+
+	/* a faster station needs more slack in the grid */
+	if (v > state->v_max) {
+		state->v_max = v;
+		return init_grid(ctx, 2.0 * v * MOVE_INTERVAL);
+	}
+	grid_update(ctx, idx);
+
+	return 0;
+}
+
+int init_kinetic_mobility(struct wmediumd *ctx)
+{
+	struct path_loss_state *state = ctx->path_loss_state;
+	struct timespec now;
+	double t;
+	int i, ret;
+
+	state->pair_gen = calloc(ctx->num_stas * ctx->num_stas, sizeof(u32));
+	if (!state->pair_gen)
+		return -ENOMEM;
+	state->kinetic = true;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	t = timespec_to_sec(&now);
+	for (i = 0; i < ctx->num_stas; i++) {
+		if (state->vel_x[i] == 0.0 && state->vel_y[i] == 0.0)
+			continue;
+		ret = kinetic_schedule_station(ctx, i, t);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+int init_continuous_mobility(struct wmediumd *ctx, double tolerance)
+{
+	struct path_loss_state *state = ctx->path_loss_state;
+	struct station *station;
+	struct timespec now;
+	double v, v_max = 0.0;
+	int i;
+
+	state->orig_x = calloc(ctx->num_stas, sizeof(double));
+	state->orig_y = calloc(ctx->num_stas, sizeof(double));
+	state->vel_x = calloc(ctx->num_stas, sizeof(double));
+	state->vel_y = calloc(ctx->num_stas, sizeof(double));
+	state->t0 = calloc(ctx->num_stas, sizeof(double));
+	state->t_end = calloc(ctx->num_stas, sizeof(double));
+	state->snr_until = calloc(ctx->num_stas * ctx->num_stas,
+				  sizeof(double));
+	if (!state->orig_x || !state->orig_y || !state->vel_x ||
+	    !state->vel_y || !state->t0 || !state->t_end ||
+	    !state->snr_until)
+		return -ENOMEM;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	list_for_each_entry(station, &ctx->stations, list) {
+		i = station->index;
+		state->orig_x[i] = station->x;
+		state->orig_y[i] = station->y;
+		state->vel_x[i] = station->dir_x / MOVE_INTERVAL;
+		state->vel_y[i] = station->dir_y / MOVE_INTERVAL;
+		state->t0[i] = timespec_to_sec(&now);
+		state->t_end[i] = INFINITY;
+
+		v = sqrt(state->vel_x[i] * state->vel_x[i] +
+			 state->vel_y[i] * state->vel_y[i]);
+		if (v > v_max)
+			v_max = v;
+	}
+	state->tolerance = tolerance;
+	state->v_max = v_max;
+
+	if (init_grid(ctx, 2.0 * v_max * MOVE_INTERVAL))
+		return -ENOMEM;
+
+	ctx->get_link_snr = get_link_snr_continuous;
+	ctx->move_stations = move_stations_continuous;
+	ctx->next_move = now;
+	ctx->next_move.tv_sec += MOVE_INTERVAL;
+
+	return 0;
+}
+
+/* Move the stations by their direction and mark them as moved */
+static void move_stations_step(struct wmediumd *ctx)
+{
+	struct path_loss_state *state = ctx->path_loss_state;
+	struct station *station;
+
+	pthread_mutex_lock(&state->grid_lock);
+	list_for_each_entry(station, &ctx->stations, list) {
+		if (station->dir_x == 0.0 && station->dir_y == 0.0)
+			continue;
+		station->x += station->dir_x;
+		station->y += station->dir_y;
+		ctx->pos_x[station->index] = station->x;
+		ctx->pos_y[station->index] = station->y;
+		station->moved = true;
+		grid_update(ctx, station->index);
+	}
+	pthread_mutex_unlock(&state->grid_lock);
+}
+
+void move_stations_to_direction(struct wmediumd *ctx)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (!timespec_before(&ctx->next_move, &now))
+		return;
+
+	move_stations_step(ctx);
+	if (recalc_path_loss_moved(ctx))
+		publish_snr_matrix(ctx);
+
+	clock_gettime(CLOCK_MONOTONIC, &ctx->next_move);
+	ctx->next_move.tv_sec += MOVE_INTERVAL;
+}
+
+void path_loss_set_snr(struct wmediumd *ctx, int i, int j, int snr)
+{
+	struct path_loss_state *state = ctx->path_loss_state;
+
+	ctx->snr_matrix[ctx->num_stas * i + j] = snr;
+	ctx->snr_matrix[ctx->num_stas * j + i] = snr;
+	__atomic_add_fetch(&ctx->link_epoch, 1, __ATOMIC_RELEASE);
+
+	if (!state->is_snr_set[i]) {
+		state->is_snr_set[i] = true;
+		state->snr_set[state->num_snr_set++] = i;
+	}
+	if (!state->is_snr_set[j]) {
+		state->is_snr_set[j] = true;
+		state->snr_set[state->num_snr_set++] = j;
+	}
+}
+
+/*
+ * Move the stations every MOVE_INTERVAL and build the next SNR matrix in
+ * the back buffer.  A new step only starts once the event loop took the
+ * previous matrix, like the event loop only moves stations when it runs.
+ * The step holds snr_lock for reading, so stations are neither added nor
+ * removed and no SNR is set by hand meanwhile.
+ */
+static void *mobility_thread(void *data)
+{
+	struct wmediumd *ctx = data;
+	struct path_loss_state *state = ctx->path_loss_state;
+	struct timespec next;
+	bool ready;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	pthread_mutex_lock(&state->snapshot_lock);
+	while (!state->stop) {
+		next.tv_sec += MOVE_INTERVAL;
+		while (!state->stop &&
+		       pthread_cond_timedwait(&state->snapshot_taken,
+					      &state->snapshot_lock,
+					      &next) != ETIMEDOUT)
+			;
+		while (!state->stop && state->snapshot_ready)
+			pthread_cond_wait(&state->snapshot_taken,
+					  &state->snapshot_lock);
+		if (state->stop)
+			break;
+		pthread_mutex_unlock(&state->snapshot_lock);
+
+		pthread_rwlock_rdlock(&snr_lock);
+		move_stations_step(ctx);
+		ready = recalc_path_loss_moved(ctx);
+
+		/* added or removed stations see the snapshot under snr_lock */
+		pthread_mutex_lock(&state->snapshot_lock);
+		if (ready)
+			__atomic_store_n(&state->snapshot_ready, true,
+					 __ATOMIC_RELEASE);
+		pthread_rwlock_unlock(&snr_lock);
+	}
+	pthread_mutex_unlock(&state->snapshot_lock);
+
+	return NULL;
+}
+
+void move_stations_background(struct wmediumd *ctx)
+{
+	struct path_loss_state *state = ctx->path_loss_state;
+
+	if (!__atomic_load_n(&state->snapshot_ready, __ATOMIC_ACQUIRE))
+		return;
+
+	pthread_mutex_lock(&state->snapshot_lock);
+	publish_snr_matrix(ctx);
+	__atomic_store_n(&state->snapshot_ready, false, __ATOMIC_RELAXED);
+	pthread_cond_signal(&state->snapshot_taken);
+	pthread_mutex_unlock(&state->snapshot_lock);
+}
+
+int init_mobility_thread(struct wmediumd *ctx)
+{
+	struct path_loss_state *state = ctx->path_loss_state;
+	struct station *station;
+	pthread_condattr_t attr;
+	double step, step_max = 0.0;
+
+	/* the grid may be one step ahead of the published matrix */
+	list_for_each_entry(station, &ctx->stations, list) {
+		step = sqrt(station->dir_x * station->dir_x +
+			    station->dir_y * station->dir_y);
+		if (step > step_max)
+			step_max = step;
+	}
+	if (init_grid(ctx, 2.0 * step_max))
+		return -ENOMEM;
+
+	/* the thread sleeps on the condition until the next step */
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_mutex_init(&state->snapshot_lock, NULL);
+	pthread_cond_init(&state->snapshot_taken, &attr);
+	pthread_condattr_destroy(&attr);
+	state->snapshot_ready = false;
+	state->stop = false;
+
+	if (pthread_create(&state->mobility_thread, NULL, mobility_thread,
+			   ctx))
+		return -EAGAIN;
+
+	ctx->move_stations = move_stations_background;
+
+	return 0;
+}
+
+void stop_mobility_thread(struct wmediumd *ctx)
+{
+	struct path_loss_state *state = ctx->path_loss_state;
+
+	if (ctx->move_stations != move_stations_background)
+		return;
+
+	pthread_mutex_lock(&state->snapshot_lock);
+	state->stop = true;
+	pthread_cond_broadcast(&state->snapshot_taken);
+	pthread_mutex_unlock(&state->snapshot_lock);
+	pthread_join(state->mobility_thread, NULL);
+}
+
+/*
+ * Take back a matrix the mobility thread built for the stations before one
+ * was added or removed, and mark the stations it moved to recalculate them
+ * instead.  The caller holds snr_lock for writing, so no step is running.
+ */
+static void drop_snapshot(struct wmediumd *ctx, int removed)
+{
+	struct path_loss_state *state = ctx->path_loss_state;
+	int i, idx;
+
+	if (ctx->move_stations != move_stations_background)
+		return;
+
+	pthread_mutex_lock(&state->snapshot_lock);
+	if (state->snapshot_ready) {
+		for (i = 0; i < state->num_moved; i++) {
+			idx = state->moved[i];
+			if (idx == removed)
+				continue;
+			if (removed >= 0 && idx > removed)
+				idx--;
+			ctx->sta_array[idx]->moved = true;
+		}
+		__atomic_store_n(&state->snapshot_ready, false,
+				 __ATOMIC_RELAXED);
+		pthread_cond_signal(&state->snapshot_taken);
+	}
+	pthread_mutex_unlock(&state->snapshot_lock);
+}
+
+/* Start the back buffer over as a copy of the resized SNR matrix */
+static void reset_back_buffer(struct wmediumd *ctx)
+{
+	struct path_loss_state *state = ctx->path_loss_state;
+	int n = ctx->num_stas;
+
+	memset(state->is_moved, 0, n * sizeof(bool));
+	memset(state->is_stale, 0, n * sizeof(bool));
+	memset(state->is_snr_set, 0, n * sizeof(bool));
+	state->num_moved = 0;
+	state->num_stale = 0;
+	state->num_snr_set = 0;
+	state->stale_all = false;
+	memcpy(ctx->snr_matrix_back, ctx->snr_matrix, n * n * sizeof(int));
+}
+
+/* The range and the grid follow the strongest station */
+static int update_range(struct wmediumd *ctx)
+{
+	struct path_loss_state *state = ctx->path_loss_state;
+	int ret;
+
+	state->range_loss = max_range_loss(ctx, state->range_margin);
+	state->range = ctx->calc_path_loss_range(ctx, -1, -1,
+						 state->range_loss);
+
+	pthread_mutex_lock(&state->grid_lock);
+	ret = init_grid(ctx, state->slack);
+	pthread_mutex_unlock(&state->grid_lock);
+	return ret;
+}
+
+/* Drop the queued crossings of a removed station, renumber the others */
+static void kinetic_remove_station(struct path_loss_state *state, int idx)
+{
+	struct kinetic_event *ev;
+	size_t i, num = 0;
+
+	for (i = 0; i < state->num_events; i++) {
+		ev = &state->events[i];
+		if (ev->i == idx || ev->j == idx)
+			continue;
+		if (ev->i > idx)
+			ev->i--;
+		if (ev->j > idx)
+			ev->j--;
+		state->events[num++] = *ev;
+	}
+
+	state->num_events = num;
+	for (i = num / 2; i-- > 0;)
+		kinetic_sift_down(state, i);
+}
+
+int path_loss_add_station(struct wmediumd *ctx, struct station *station)
+{
+	struct path_loss_state *state = ctx->path_loss_state;
+	int n = ctx->num_stas, idx = station->index, i;
+	int workers = worker_pool_size(state->pool);
+	int rows = n / 2 > workers ? n / 2 : workers;
+	size_t len = path_loss_vec_size(n);
+	struct timespec now;
+	double t;
+
+	drop_snapshot(ctx, -1);
+
+	if (resize_array(&ctx->pos_x, len, sizeof(float)) ||
+	    resize_array(&ctx->pos_y, len, sizeof(float)) ||
+	    resize_array(&ctx->pos_z, len, sizeof(float)) ||
+	    resize_array(&ctx->tx_powers, len, sizeof(int)) ||
+	    (ctx->freq_offsets &&
+	     resize_array(&ctx->freq_offsets, len, sizeof(float))) ||
+	    (ctx->sta_antennas &&
+	     resize_array(&ctx->sta_antennas, n,
+			  sizeof(*ctx->sta_antennas))) ||
+	    resize_array(&ctx->snr_matrix_back, n * n, sizeof(int)) ||
+	    resize_array(&state->scratch, workers * len, sizeof(float)) ||
+	    resize_array(&state->neighbors, workers * n, sizeof(int)) ||
+	    resize_array(&state->moved_rows, rows * len, sizeof(float)) ||
+	    resize_array(&state->moved, n, sizeof(int)) ||
+	    resize_array(&state->stale, n, sizeof(int)) ||
+	    resize_array(&state->is_moved, n, sizeof(bool)) ||
+	    resize_array(&state->is_stale, n, sizeof(bool)) ||
+	    resize_array(&state->snr_set, n, sizeof(int)) ||
+	    resize_array(&state->is_snr_set, n, sizeof(bool)))
+		return -ENOMEM;
+
+	ctx->pos_x[idx] = station->x;
+	ctx->pos_y[idx] = station->y;
+	ctx->pos_z[idx] = station->z;
+	ctx->tx_powers[idx] = station->tx_power;
+	if (ctx->freq_offsets)
+		ctx->freq_offsets[idx] = station->freq > 0 ?
+			10.0 * log10(station->freq * 1e6 / FREQ_1CH) : 0.0;
+	if (ctx->sta_antennas) {
+		ctx->sta_antennas[idx].pattern = NULL;
+		ctx->sta_antennas[idx].cos = 1.0f;
+		ctx->sta_antennas[idx].sin = 0.0f;
+	}
+
+	if (state->obstacle_loss) {
+		if (grow_pairs(&state->obstacle_loss, n - 1, sizeof(float)))
+			return -ENOMEM;
+		for (i = 0; i < n; i++) {
+			state->obstacle_loss[n * idx + i] = NAN;
+			state->obstacle_loss[n * i + idx] = NAN;
+		}
+	}
+
+	reset_back_buffer(ctx);
+	if (update_range(ctx))
+		return -ENOMEM;
+
+	if (!state->orig_x) {
+		station->moved = true;
+		if (recalc_path_loss_moved(ctx))
+			publish_snr_matrix(ctx);
+		return 0;
+	}
+
+	if (resize_array(&state->orig_x, n, sizeof(double)) ||
+	    resize_array(&state->orig_y, n, sizeof(double)) ||
+	    resize_array(&state->vel_x, n, sizeof(double)) ||
+	    resize_array(&state->vel_y, n, sizeof(double)) ||
+	    resize_array(&state->t0, n, sizeof(double)) ||
+	    resize_array(&state->t_end, n, sizeof(double)) ||
+	    grow_pairs(&state->snr_until, n - 1, sizeof(double)) ||
+	    (state->kinetic &&
+	     grow_pairs(&state->pair_gen, n - 1, sizeof(u32))))
+		return -ENOMEM;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	t = timespec_to_sec(&now);
+	state->orig_x[idx] = station->x;
+	state->orig_y[idx] = station->y;
+	state->vel_x[idx] = 0.0;
+	state->vel_y[idx] = 0.0;
+	state->t0[idx] = t;
+	state->t_end[idx] = INFINITY;
+
+	if (state->kinetic)
+		return kinetic_schedule_station(ctx, idx, t);
+	for (i = 0; i < n; i++) {
+		if (i != idx)
+			update_link_continuous(ctx, i, idx, t);
+	}
+
+	return 0;
+}
+
+int path_loss_del_station(struct wmediumd *ctx, int idx)
+{
+	struct path_loss_state *state = ctx->path_loss_state;
+	int old = ctx->num_stas + 1;
+
+	drop_snapshot(ctx, idx);
+
+	remove_entry(ctx->pos_x, old, idx, sizeof(float));
+	remove_entry(ctx->pos_y, old, idx, sizeof(float));
+	remove_entry(ctx->pos_z, old, idx, sizeof(float));
+	remove_entry(ctx->tx_powers, old, idx, sizeof(int));
+	if (ctx->freq_offsets)
+		remove_entry(ctx->freq_offsets, old, idx, sizeof(float));
+	if (ctx->sta_antennas)
+		remove_entry(ctx->sta_antennas, old, idx,
+			     sizeof(*ctx->sta_antennas));
+	if (state->obstacle_loss)
+		remove_pairs(state->obstacle_loss, old, idx, sizeof(float));
+
+	reset_back_buffer(ctx);
+	if (update_range(ctx))
+		return -ENOMEM;
+
+	if (!state->orig_x) {
+		if (recalc_path_loss_moved(ctx))
+			publish_snr_matrix(ctx);
+		return 0;
+	}
+
+	remove_entry(state->orig_x, old, idx, sizeof(double));
+	remove_entry(state->orig_y, old, idx, sizeof(double));
+	remove_entry(state->vel_x, old, idx, sizeof(double));
+	remove_entry(state->vel_y, old, idx, sizeof(double));
+	remove_entry(state->t0, old, idx, sizeof(double));
+	remove_entry(state->t_end, old, idx, sizeof(double));
+	remove_pairs(state->snr_until, old, idx, sizeof(double));
+	if (state->kinetic) {
+		remove_pairs(state->pair_gen, old, idx, sizeof(u32));
+		kinetic_remove_station(state, idx);
+	}
+
+	return 0;
+}
@@ -0,0 +1,264 @@
+/*
+ * Path loss models and the recalculation of the SNR matrix from station
+ * positions.
+ */
+
+#ifndef WMEDIUMD_PATH_LOSS_H
+#define WMEDIUMD_PATH_LOSS_H
+
+#include "wmediumd.h"
+
+#define FREQ_1CH (2.412e9)		// [Hz]
+
+/* entries of the table of shadowing quantiles, a power of two */
+#define SHADOWING_TABLE_SIZE	(1024)
+
+/*
+ * Default margin below the CCA threshold at which stations are out of
+ * range, on top of four standard deviations of gaussian fading [dB]
+ */
+#define PATH_LOSS_RANGE_MARGIN	(10)
+
+/* default change of path loss before a link is evaluated again [dB] */
+#define MOBILITY_TOLERANCE	(1.0)
+
+/**
+ * Calculate the path loss between two stations with the log distance model
+ * @param model_param The struct log_distance_model_param of the model
+ * @param dst The receiving station
+ * @param src The sending station
+ * @return The path loss [dB]
+ */
+int calc_path_loss_log_distance(void *model_param, struct station *dst,
+				struct station *src);
+
+/**
+ * Calculate the path loss from one station to many stations with the log
+ * distance model, which also covers free space and ITU-R P.1238
+ * @param ctx The wmediumd context
+ * @param src The index of the sending station
+ * @param dst The indices of the receiving stations or NULL for the stations
+ * 0 to num - 1
+ * @param num The number of receiving stations
+ * @param path_loss Where to store the path loss to each receiving station,
+ * padded to a multiple of four entries [dB]
+ */
+void calc_path_loss_row_log_distance(struct wmediumd *ctx, int src,
+				     const int *dst, int num,
+				     float *path_loss);
+
+/**
+ * Calculate the distance at which the log distance model reaches a path loss
+ * @param ctx The wmediumd context
+ * @param src The index of a station of the link or -1 for any link
+ * @param dst The index of the other station of the link or -1
+ * @param path_loss The path loss [dB]
+ * @return The distance [m], INFINITY if the path loss is never reached
+ */
+double calc_path_loss_range_log_distance(struct wmediumd *ctx, int src,
+					 int dst, double path_loss);
+
+/**
+ * Calculate the path loss from one station to many stations with the
+ * two-ray ground reflection model
+ * @see calc_path_loss_row_log_distance()
+ */
+void calc_path_loss_row_two_ray_ground(struct wmediumd *ctx, int src,
+				       const int *dst, int num,
+				       float *path_loss);
+
+/**
+ * Calculate the distance at which the two-ray ground reflection model
+ * reaches a path loss
+ * @see calc_path_loss_range_log_distance()
+ */
+double calc_path_loss_range_two_ray_ground(struct wmediumd *ctx, int src,
+					   int dst, double path_loss);
+
+/**
+ * Calculate the path loss from one station to many stations with the log
+ * distance model and log-normal shadowing
+ * @see calc_path_loss_row_log_distance()
+ */
+void calc_path_loss_row_log_normal_shadowing(struct wmediumd *ctx, int src,
+					     const int *dst, int num,
+					     float *path_loss);
+
+/**
+ * Calculate the distance at which the log-normal shadowing model reaches a
+ * path loss, with the strongest shadowing for any link
+ * @see calc_path_loss_range_log_distance()
+ */
+double calc_path_loss_range_log_normal_shadowing(struct wmediumd *ctx,
+						 int src, int dst,
+						 double path_loss);
+
+/**
+ * Fill the table of shadowing quantiles of the log-normal shadowing model
+ * @param param The model parameters
+ * @param sigma The standard deviation of the shadowing [dB]
+ * @return 0 on success otherwise a negative errno value
+ */
+int init_log_normal_shadowing(struct log_normal_shadowing_model_param *param,
+			      double sigma);
+
+/**
+ * Get the stations within range of a station
+ *
+ * The returned array is reused by the next call.
+ * @param ctx The wmediumd context
+ * @param src The sending station
+ * @param num Where to store the number of stations
+ * @return The indices of the stations in range
+ */
+const int *get_reachable_stations_grid(struct wmediumd *ctx,
+				       struct station *src, int *num);
+
+/**
+ * Free-space path loss at the 1 meter reference distance
+ * @return The path loss [dB]
+ */
+double log_distance_reference_loss(void);
+
+/**
+ * Copy station positions and tx powers into the position arrays and
+ * calculate the whole SNR matrix
+ * @param ctx The wmediumd context
+ * @param threads The number of threads recalculating the SNR matrix, 0 to
+ * pick one from the number of stations and CPUs
+ * @param range_margin How far below the CCA threshold a signal has to be
+ * for the stations to be unreachable [dB]
+ * @return 0 on success otherwise a negative errno value
+ */
+int init_path_loss(struct wmediumd *ctx, int threads, double range_margin);
+
+/**
+ * Move stations along their direction every MOVE_INTERVAL and update the
+ * SNR matrix of the stations that moved
+ * @param ctx The wmediumd context
+ */
+void move_stations_to_direction(struct wmediumd *ctx);
+
+/**
+ * Get the SNR of a link at the current time with continuous mobility
+ *
+ * The SNR is cached until the path loss may have changed by more than the
+ * tolerance.
+ * @param ctx The wmediumd context
+ * @param sender The sending station
+ * @param receiver The receiving station
+ * @return The SNR [dB]
+ */
+int get_link_snr_continuous(struct wmediumd *ctx, struct station *sender,
+			    struct station *receiver);
+
+/**
+ * Refresh the station positions every MOVE_INTERVAL with continuous mobility
+ * @param ctx The wmediumd context
+ */
+void move_stations_continuous(struct wmediumd *ctx);
+
+/**
+ * Move stations continuously along their direction instead of in steps
+ * of MOVE_INTERVAL, evaluating the SNR of a link only when it is used
+ * @param ctx The wmediumd context, after init_path_loss()
+ * @param tolerance How much the path loss may change before the SNR of a
+ * link is evaluated again [dB]
+ * @return 0 on success otherwise a negative errno value
+ */
+int init_continuous_mobility(struct wmediumd *ctx, double tolerance);
+
+/**
+ * Keep the SNR matrix up to date with continuous mobility by queueing the
+ * time at which the path loss of each moving pair crosses the next multiple
+ * of the tolerance, instead of evaluating links when they are used
+ * @param ctx The wmediumd context, after init_continuous_mobility()
+ * @return 0 on success otherwise a negative errno value
+ */
+int init_kinetic_mobility(struct wmediumd *ctx);
+
+/**
+ * Get the position of a station at a time with continuous mobility
+ * @param ctx The wmediumd context
+ * @param idx The index of the station
+ * @param t The time [s, CLOCK_MONOTONIC]
+ * @param x Where to store the x coordinate [m]
+ * @param y Where to store the y coordinate [m]
+ */
+void path_loss_get_position(struct wmediumd *ctx, int idx, double t,
+			    double *x, double *y);
+
+/**
+ * Let a station move linearly from a position with continuous mobility
+ *
+ * The cached SNRs of the station are invalidated.
+ * @param ctx The wmediumd context
+ * @param idx The index of the station
+ * @param t The time the station is at the position [s, CLOCK_MONOTONIC]
+ * @param x The x coordinate [m]
+ * @param y The y coordinate [m]
+ * @param vx The speed along x [m/s]
+ * @param vy The speed along y [m/s]
+ * @param t_end The time the station stops [s, CLOCK_MONOTONIC]
+ * @return 0 on success otherwise a negative errno value
+ */
+int path_loss_set_trajectory(struct wmediumd *ctx, int idx, double t,
+			     double x, double y, double vx, double vy,
+			     double t_end);
+
+/**
+ * Set the SNR of a pair of stations in both directions by hand
+ *
+ * The SNR holds until one of the stations moves.  The caller holds
+ * snr_lock for writing.
+ * @param ctx The wmediumd context, after init_path_loss()
+ * @param i The index of one station
+ * @param j The index of the other station
+ * @param snr The SNR [dB]
+ */
+void path_loss_set_snr(struct wmediumd *ctx, int i, int j, int snr);
+
+/**
+ * Make room for a station added to the end of sta_array
+ *
+ * The caller holds snr_lock for writing and already grew num_stas and the
+ * SNR matrix.  A matrix the mobility thread built for the old stations is
+ * dropped, and the SNRs of the new station are calculated.
+ * @param ctx The wmediumd context, after init_path_loss()
+ * @param station The new station
+ * @return 0 on success otherwise a negative errno value
+ */
+int path_loss_add_station(struct wmediumd *ctx, struct station *station);
+
+/**
+ * Drop a removed station from the positions, the grid and the caches
+ *
+ * The caller holds snr_lock for writing and already shrank num_stas,
+ * sta_array and the SNR matrix.
+ * @param ctx The wmediumd context, after init_path_loss()
+ * @param idx The index the station had
+ * @return 0 on success otherwise a negative errno value
+ */
+int path_loss_del_station(struct wmediumd *ctx, int idx);
+
+/**
+ * Publish the SNR matrix built by the mobility thread, if there is one
+ * @param ctx The wmediumd context
+ */
+void move_stations_background(struct wmediumd *ctx);
+
+/**
+ * Move the stations along their direction and recalculate the SNR matrix
+ * on a thread of its own, leaving only the pointer swap to the event loop
+ * @param ctx The wmediumd context, after init_path_loss()
+ * @return 0 on success otherwise a negative errno value
+ */
+int init_mobility_thread(struct wmediumd *ctx);
+
+/**
+ * Stop and join the mobility thread, if there is one
+ * @param ctx The wmediumd context
+ */
+void stop_mobility_thread(struct wmediumd *ctx);
+
+#endif //WMEDIUMD_PATH_LOSS_H
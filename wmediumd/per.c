@@ -197,19 +197,18 @@ double get_error_prob_from_snr(double snr, unsigned int rate_idx, int frame_len)
 	return per(ber, fec, frame_len);
 }
 
-static double get_error_prob_from_per_matrix(struct wmediumd *ctx, double snr,
-					     unsigned int rate_idx,
-					     int frame_len, struct station *src,
-					     struct station *dst)
+static double per_table_lookup(struct wmediumd *ctx, const float *matrix,
+			       int row_num, int signal_min, double snr,
+			       unsigned int rate_idx)
 {
 	int signal_idx;
 
-	signal_idx = snr + NOISE_LEVEL - ctx->per_matrix_signal_min;
+	signal_idx = snr + NOISE_LEVEL - signal_min;
 
 	if (signal_idx < 0)
 		return 1.0;
 
-	if (signal_idx >= ctx->per_matrix_row_num)
+	if (signal_idx >= row_num)
 		return 0.0;
 
 	if (rate_idx >= PER_MATRIX_RATE_LEN) {
@@ -218,10 +217,49 @@ static double get_error_prob_from_per_matrix(struct wmediumd *ctx, double snr,
 		exit(EXIT_FAILURE);
 	}
 
-	return ctx->per_matrix[signal_idx * PER_MATRIX_RATE_LEN + rate_idx];
+	return matrix[signal_idx * PER_MATRIX_RATE_LEN + rate_idx];
 }
 
-int read_per_file(struct wmediumd *ctx, const char *file_name)
+static double get_error_prob_from_per_matrix(struct wmediumd *ctx, double snr,
+					     unsigned int rate_idx,
+					     int frame_len, struct station *src,
+					     struct station *dst)
+{
+	return per_table_lookup(ctx, ctx->per_matrix, ctx->per_matrix_row_num,
+				ctx->per_matrix_signal_min, snr, rate_idx);
+}
+
+/*
+ * Resolve the error probability through the PER class of the link.
+ * Links without a class fall back to the -x table or the analytic model.
+ */
+double get_error_prob_from_per_class(struct wmediumd *ctx, double snr,
+				     unsigned int rate_idx, int frame_len,
+				     struct station *src, struct station *dst)
+{
+	struct per_class *cls;
+	u8 cls_idx;
+
+	if (dst == NULL)
+		cls_idx = ctx->per_class_default;
+	else
+		cls_idx = ctx->per_class_matrix[src->index * ctx->num_stas +
+						dst->index];
+
+	if (cls_idx >= ctx->per_class_num) {
+		if (ctx->per_matrix)
+			return get_error_prob_from_per_matrix(ctx, snr,
+				rate_idx, frame_len, src, dst);
+		return get_error_prob_from_snr(snr, rate_idx, frame_len);
+	}
+
+	cls = &ctx->per_classes[cls_idx];
+	return per_table_lookup(ctx, cls->matrix, cls->row_num,
+				cls->signal_min, snr, rate_idx);
+}
+
+static int read_per_table(struct wmediumd *ctx, const char *file_name,
+			  float **matrix, int *row_num, int *signal_min)
 {
 	FILE *fp;
 	char line[256];
@@ -235,7 +273,7 @@ int read_per_file(struct wmediumd *ctx, const char *file_name)
 		return EXIT_FAILURE;
 	}
 
-	ctx->per_matrix_signal_min = 1000;
+	*signal_min = 1000;
 	while (fscanf(fp, "%s", line) != EOF){
 		if (line[0] == '#') {
 			if (fgets(line, sizeof(line), fp) == NULL) {
@@ -247,28 +285,28 @@ int read_per_file(struct wmediumd *ctx, const char *file_name)
 		}
 
 		signal = atoi(line);
-		if (ctx->per_matrix_signal_min > signal)
-			ctx->per_matrix_signal_min = signal;
+		if (*signal_min > signal)
+			*signal_min = signal;
 
-		if (signal - ctx->per_matrix_signal_min < 0) {
+		if (signal - *signal_min < 0) {
 			w_flogf(ctx, LOG_ERR, stderr,
 				"%s: invalid signal=%d\n", __func__, signal);
 			return EXIT_FAILURE;
 		}
 
-		temp = realloc(ctx->per_matrix, sizeof(float) *
+		temp = realloc(*matrix, sizeof(float) *
 				PER_MATRIX_RATE_LEN *
-				++ctx->per_matrix_row_num);
+				++(*row_num));
 		if (temp == NULL) {
 			w_flogf(ctx, LOG_ERR, stderr,
 				"Out of memory(PER file)\n");
 			return EXIT_FAILURE;
 		}
-		ctx->per_matrix = temp;
+		*matrix = temp;
 
 		for (i = 0; i < PER_MATRIX_RATE_LEN; i++) {
-			if (fscanf(fp, "%f", &ctx->per_matrix[
-				(signal - ctx->per_matrix_signal_min) *
+			if (fscanf(fp, "%f", &(*matrix)[
+				(signal - *signal_min) *
 				PER_MATRIX_RATE_LEN + i]) == EOF) {
 				w_flogf(ctx, LOG_ERR, stderr,
 					"Not enough rate found\n");
@@ -277,7 +315,27 @@ int read_per_file(struct wmediumd *ctx, const char *file_name)
 		}
 	}
 
+	return EXIT_SUCCESS;
+}
+
+int read_per_file(struct wmediumd *ctx, const char *file_name)
+{
+	if (read_per_table(ctx, file_name, &ctx->per_matrix,
+			   &ctx->per_matrix_row_num,
+			   &ctx->per_matrix_signal_min))
+		return EXIT_FAILURE;
+
 	ctx->get_error_prob = get_error_prob_from_per_matrix;
 
 	return EXIT_SUCCESS;
 }
+
+int read_per_class_file(struct wmediumd *ctx, struct per_class *cls,
+			const char *file_name)
+{
+	cls->matrix = NULL;
+	cls->row_num = 0;
+
+	return read_per_table(ctx, file_name, &cls->matrix, &cls->row_num,
+			      &cls->signal_min);
+}
@@ -0,0 +1,173 @@
+/*
+ * Fast per-thread pseudo random numbers for the medium simulation.
+ *
+ * Every thread owns a xoshiro256** state, so drawing needs neither locks
+ * nor the shared drand48() state.  It only picks the default seed.
+ *
+ * Reproducible decisions use counter-based streams instead: Philox4x32-10
+ * keyed by the global seed, with the counter made of (sender, receiver,
+ * frame sequence, block).  A stream yields the same numbers no matter
+ * which thread draws them or in which order frames are processed.  Normal
+ * variates use the Box-Muller transform and keep the second value of each
+ * pair for the next call.
+ *
+ * See http://prng.di.unimi.it/,
+ * https://en.wikipedia.org/wiki/Box%E2%80%93Muller_transform and
+ * Salmon et al., "Parallel random numbers: as easy as 1, 2, 3", SC 2011
+ */
+
+#include <stdbool.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "rng.h"
+
+struct rng_state {
+	uint64_t s[4];
+	bool seeded;
+};
+
+static __thread struct rng_state rng;
+
+static inline uint64_t rotl(uint64_t x, int k)
+{
+	return (x << k) | (x >> (64 - k));
+}
+
+static uint64_t splitmix64(uint64_t *x)
+{
+	uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+static void rng_seed_default(void)
+{
+	struct timespec now;
+	uint64_t seed;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	seed = ((uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec) ^
+		(uint64_t)pthread_self();
+
+	/* splitmix64 never yields an all-zero xoshiro state */
+	for (i = 0; i < 4; i++)
+		rng.s[i] = splitmix64(&seed);
+	rng.seeded = true;
+}
+
+uint64_t rng_u64(void)
+{
+	uint64_t *s = rng.s;
+	uint64_t result, t;
+
+	if (!rng.seeded)
+		rng_seed_default();
+
+	result = rotl(s[1] * 5, 7) * 9;
+	t = s[1] << 17;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotl(s[3], 45);
+
+	return result;
+}
+
+/*
+ * Box-Muller transform of u1 in [0, 1) and u2 in [0, 1)
+ */
+static inline double box_muller(double u1, double u2, double *spare)
+{
+	/* 1 - u1 in (0, 1] keeps log() finite */
+	double r = sqrt(-2.0 * log(1.0 - u1));
+
+	*spare = r * sin(2.0 * M_PI * u2);
+	return r * cos(2.0 * M_PI * u2);
+}
+
+#define PHILOX_M0	(0xD2511F53U)
+#define PHILOX_M1	(0xCD9E8D57U)
+#define PHILOX_W0	(0x9E3779B9U)
+#define PHILOX_W1	(0xBB67AE85U)
+#define PHILOX_ROUNDS	(10)
+
+static void philox4x32(const uint32_t ctr[4], const uint32_t key[2],
+		       uint32_t out[4])
+{
+	uint32_t c0 = ctr[0], c1 = ctr[1], c2 = ctr[2], c3 = ctr[3];
+	uint32_t k0 = key[0], k1 = key[1];
+	uint64_t p0, p1;
+	int i;
+
+	for (i = 0; i < PHILOX_ROUNDS; i++) {
+		p0 = (uint64_t)PHILOX_M0 * c0;
+		p1 = (uint64_t)PHILOX_M1 * c2;
+		c0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+		c2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+		c1 = (uint32_t)p1;
+		c3 = (uint32_t)p0;
+		k0 += PHILOX_W0;
+		k1 += PHILOX_W1;
+	}
+
+	out[0] = c0;
+	out[1] = c1;
+	out[2] = c2;
+	out[3] = c3;
+}
+
+void rng_stream_init(struct rng_stream *s, uint64_t seed, uint32_t src,
+		     uint32_t dst, uint32_t seq)
+{
+	s->key[0] = (uint32_t)seed;
+	s->key[1] = (uint32_t)(seed >> 32);
+	s->ctr[0] = 0;
+	s->ctr[1] = seq;
+	s->ctr[2] = src;
+	s->ctr[3] = dst;
+	s->used = 4;
+	s->has_spare = false;
+}
+
+static uint64_t rng_stream_u64(struct rng_stream *s)
+{
+	uint64_t v;
+
+	if (s->used > 2) {
+		philox4x32(s->ctr, s->key, s->out);
+		s->ctr[0]++;
+		s->used = 0;
+	}
+
+	v = ((uint64_t)s->out[s->used] << 32) | s->out[s->used + 1];
+	s->used += 2;
+	return v;
+}
+
+double rng_stream_uniform(struct rng_stream *s)
+{
+	/* upper 53 bits fill the mantissa of a double in [0, 1) */
+	return (rng_stream_u64(s) >> 11) * 0x1.0p-53;
+}
+
+double rng_stream_normal(struct rng_stream *s)
+{
+	double u1;
+
+	if (s->has_spare) {
+		s->has_spare = false;
+		return s->spare;
+	}
+
+	u1 = rng_stream_uniform(s);
+	s->has_spare = true;
+	return box_muller(u1, rng_stream_uniform(s), &s->spare);
+}
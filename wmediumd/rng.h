@@ -0,0 +1,66 @@
+/*
+ * Fast per-thread pseudo random numbers for the medium simulation.
+ */
+
+#ifndef WMEDIUMD_RNG_H
+#define WMEDIUMD_RNG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Draw 64 random bits from the generator of the calling thread
+ * @return The random bits
+ */
+uint64_t rng_u64(void);
+
+/**
+ * Receiver index used for the stream of a multicast frame as a whole
+ */
+#define RNG_STREAM_MCAST	(0xffffffff)
+
+/**
+ * Receiver index used for the stream deciding whether overlapping
+ * transmissions destroy a frame at a receiver
+ */
+#define RNG_STREAM_OVERLAP(dst)	((uint32_t)(dst) | 0x80000000)
+
+/**
+ * Counter-based random stream of one frame on one link
+ */
+struct rng_stream {
+	uint32_t key[2];
+	uint32_t ctr[4];
+	uint32_t out[4];
+	int used;
+	bool has_spare;
+	double spare;
+};
+
+/**
+ * Open the random stream of a frame on a link.  The stream only depends
+ * on its arguments, never on draws made elsewhere.
+ * @param s The stream to initialize
+ * @param seed The global seed of the run
+ * @param src The index of the sending station
+ * @param dst The index of the receiving station or RNG_STREAM_MCAST
+ * @param seq The sequence number of the frame at the sender
+ */
+void rng_stream_init(struct rng_stream *s, uint64_t seed, uint32_t src,
+		     uint32_t dst, uint32_t seq);
+
+/**
+ * Draw a uniformly distributed double from a stream
+ * @param s The stream
+ * @return A value in [0, 1)
+ */
+double rng_stream_uniform(struct rng_stream *s);
+
+/**
+ * Draw a standard normal distributed double from a stream
+ * @param s The stream
+ * @return The random value
+ */
+double rng_stream_normal(struct rng_stream *s);
+
+#endif //WMEDIUMD_RNG_H
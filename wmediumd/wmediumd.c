@@ -41,6 +41,11 @@
 #include "wserver.h"
 #include "wmediumd_dynamic.h"
 #include "wserver_messages.h"
+#include "airtime.h"
+#include "edca.h"
+#include "path_loss.h"
+#include "antenna.h"
+#include "fading.h"
 
 static int index_to_rate[] = {
 	60, 90, 120, 180, 240, 360, 480, 540
@@ -57,6 +62,12 @@ static inline int pkt_duration(int len, int rate)
 	return 16 + 4 + 4 * div_round((16 + 8 * len + 6) * 10, 4 * rate);
 }
 
+static inline int ampdu_subframe_duration(int len, int rate)
+{
+	/* t_sym * n_sym of the delimiter, the frame and its padding */
+	return 4 * div_round(8 * ((len + 4 + 3) & ~3) * 10, 4 * rate);
+}
+
 int w_logf(struct wmediumd *ctx, u8 level, const char *format, ...)
 {
 	va_list(args);
@@ -77,19 +88,26 @@ int w_flogf(struct wmediumd *ctx, u8 level, FILE *stream, const char *format, ..
 	return -1;
 }
 
-static void wqueue_init(struct wqueue *wqueue, int cw_min, int cw_max)
+static void wqueue_init(struct wqueue *wqueue, int aifsn, int cw_min,
+			int cw_max, int txop_limit)
 {
 	INIT_LIST_HEAD(&wqueue->frames);
+	wqueue->aifsn = aifsn;
 	wqueue->cw_min = cw_min;
 	wqueue->cw_max = cw_max;
+	wqueue->txop_limit = txop_limit;
+	wqueue->txop_end.tv_sec = 0;
+	wqueue->txop_end.tv_nsec = 0;
+	wqueue->ampdu_num = 0;
 }
 
 void station_init_queues(struct station *station)
 {
-	wqueue_init(&station->queues[IEEE80211_AC_BK], 15, 1023);
-	wqueue_init(&station->queues[IEEE80211_AC_BE], 15, 1023);
-	wqueue_init(&station->queues[IEEE80211_AC_VI], 7, 15);
-	wqueue_init(&station->queues[IEEE80211_AC_VO], 3, 7);
+	/* default EDCA parameters of OFDM PHYs, TXOP limits in usec */
+	wqueue_init(&station->queues[IEEE80211_AC_BK], 7, 15, 1023, 0);
+	wqueue_init(&station->queues[IEEE80211_AC_BE], 3, 15, 1023, 0);
+	wqueue_init(&station->queues[IEEE80211_AC_VI], 2, 7, 15, 3008);
+	wqueue_init(&station->queues[IEEE80211_AC_VO], 2, 3, 7, 1504);
 }
 
 bool timespec_before(struct timespec *t1, struct timespec *t2)
@@ -107,6 +125,17 @@ void timespec_add_usec(struct timespec *t, int usec)
 	}
 }
 
+static u64 timespec_to_usec(struct timespec *t)
+{
+	return (u64)t->tv_sec * 1000000 + t->tv_nsec / 1000;
+}
+
+static void usec_to_timespec(u64 usec, struct timespec *t)
+{
+	t->tv_sec = usec / 1000000;
+	t->tv_nsec = (usec % 1000000) * 1000;
+}
+
 // a - b = c
 static int timespec_sub(struct timespec *a, struct timespec *b,
 			struct timespec *c)
@@ -125,9 +154,10 @@ static int timespec_sub(struct timespec *a, struct timespec *b,
 
 void rearm_timer(struct wmediumd *ctx)
 {
-	struct timespec min_expires;
+	struct timespec min_expires, next_round;
 	struct itimerspec expires;
 	struct station *station;
+	struct medium *medium;
 	struct frame *frame;
 	int i;
 
@@ -142,7 +172,7 @@ void rearm_timer(struct wmediumd *ctx)
 			frame = list_first_entry_or_null(&station->queues[i].frames,
 							 struct frame, list);
 
-			if (frame && (!set_min_expires ||
+			if (frame && frame->scheduled && (!set_min_expires ||
 				      timespec_before(&frame->expires,
 						      &min_expires))) {
 				set_min_expires = true;
@@ -151,6 +181,19 @@ void rearm_timer(struct wmediumd *ctx)
 		}
 	}
 
+	/* the next contention round starts when its first backoff expires */
+	for (i = 0; i < ctx->num_media; i++) {
+		medium = ctx->media[i];
+		if (!medium->edca || !medium->edca->active)
+			continue;
+		usec_to_timespec(medium->next_round, &next_round);
+		if (!set_min_expires ||
+		    timespec_before(&next_round, &min_expires)) {
+			set_min_expires = true;
+			min_expires = next_round;
+		}
+	}
+
 	if (set_min_expires) {
 		memset(&expires, 0, sizeof(expires));
 		expires.it_value = min_expires;
@@ -174,6 +217,20 @@ static inline bool frame_is_mgmt(struct frame *frame)
 	return (hdr->frame_control[0] & FCTL_FTYPE) == FTYPE_MGMT;
 }
 
+static inline bool frame_is_probe_req(struct frame *frame)
+{
+	struct ieee80211_hdr *hdr = (void *)frame->data;
+
+	return (hdr->frame_control[0] & (FCTL_FTYPE | FCTL_STYPE)) ==
+		(FTYPE_MGMT | STYPE_PROBE_REQ);
+}
+
+/* whether two channels may be the same, an unknown one matches any */
+static inline bool freq_matches(int freq, int other)
+{
+	return freq == FREQ_UNKNOWN || other == FREQ_UNKNOWN || freq == other;
+}
+
 static inline bool frame_is_data(struct frame *frame)
 {
 	struct ieee80211_hdr *hdr = (void *)frame->data;
@@ -216,9 +273,21 @@ static enum ieee80211_ac_number frame_select_queue_80211(struct frame *frame)
 	return ieee802_1d_to_ac[priority];
 }
 
+#define INTF_LIMIT (31)
+
+/* power relative to the noise level of each signal within INTF_LIMIT */
+static double intf_milliwatt[2 * INTF_LIMIT - 1];
+
+static void init_milliwatt_table(void)
+{
+	int i;
+
+	for (i = 0; i < 2 * INTF_LIMIT - 1; i++)
+		intf_milliwatt[i] = pow(10.0, (i - INTF_LIMIT + 1) / 10.0);
+}
+
 static double dBm_to_milliwatt(int decibel_intf)
 {
-#define INTF_LIMIT (31)
 	int intf_diff = NOISE_LEVEL - decibel_intf;
 
 	if (intf_diff >= INTF_LIMIT)
@@ -227,7 +296,7 @@ static double dBm_to_milliwatt(int decibel_intf)
 	if (intf_diff <= -INTF_LIMIT)
 		return 1000.0;
 
-	return pow(10.0, -intf_diff / 10.0);
+	return intf_milliwatt[INTF_LIMIT - 1 - intf_diff];
 }
 
 static double milliwatt_to_dBm(double value)
@@ -238,39 +307,49 @@ static double milliwatt_to_dBm(double value)
 static int set_interference_duration(struct wmediumd *ctx, int src_idx,
 				     int duration, int signal)
 {
-	int i;
-
 	if (!ctx->intf)
 		return 0;
 
 	if (signal >= CCA_THRESHOLD)
 		return 0;
 
-	for (i = 0; i < ctx->num_stas; i++) {
-		ctx->intf[ctx->num_stas * src_idx + i].duration += duration;
-		// use only latest value
-		ctx->intf[ctx->num_stas * src_idx + i].signal = signal;
-	}
+	if (!ctx->intf[src_idx].duration && duration > 0)
+		ctx->intf_dirty[ctx->intf_num_dirty++] = src_idx;
+	ctx->intf[src_idx].duration += duration;
+	// use only latest value
+	ctx->intf[src_idx].signal = signal;
 
 	return 1;
 }
 
+/*
+ * Sum up the stations that were on the air in the last window and may
+ * collide with a frame.  Stations that the receiver hears below the noise
+ * level are left out.
+ */
 static int get_signal_offset_by_interference(struct wmediumd *ctx, int src_idx,
-					     int dst_idx)
+					     int dst_idx,
+					     struct rng_stream *rng)
 {
-	int i;
+	struct station *receiver;
+	int i, k;
 	double intf_power;
 
 	if (!ctx->intf)
 		return 0;
 
+	receiver = ctx->sta_array[dst_idx];
 	intf_power = 0.0;
-	for (i = 0; i < ctx->num_stas; i++) {
+	for (k = 0; k < ctx->intf_num_active; k++) {
+		i = ctx->intf_active[k];
 		if (i == src_idx || i == dst_idx)
 			continue;
-		if (drand48() < ctx->intf[i * ctx->num_stas + dst_idx].prob_col)
-			intf_power += dBm_to_milliwatt(
-				ctx->intf[i * ctx->num_stas + dst_idx].signal);
+		if (!freq_matches(ctx->sta_array[i]->freq, receiver->freq))
+			continue;
+		if (ctx->get_link_snr(ctx, ctx->sta_array[i], receiver) < 0)
+			continue;
+		if (rng_stream_uniform(rng) < ctx->intf[i].prob_col)
+			intf_power += dBm_to_milliwatt(ctx->intf[i].signal);
 	}
 
 	if (intf_power <= 1.0)
@@ -279,6 +358,103 @@ static int get_signal_offset_by_interference(struct wmediumd *ctx, int src_idx,
 	return (int)(milliwatt_to_dBm(intf_power) + 0.5);
 }
 
+struct overlap_power {
+	struct wmediumd *ctx;
+	int src_idx, dst_idx;
+	double power;
+};
+
+static void add_overlap_power(void *arg, int sender)
+{
+	struct overlap_power *sum = arg;
+	struct wmediumd *ctx = sum->ctx;
+	int snr;
+
+	if (sender == sum->src_idx || sender == sum->dst_idx)
+		return;
+	if (!freq_matches(ctx->sta_array[sender]->freq,
+			  ctx->sta_array[sum->dst_idx]->freq))
+		return;
+
+	snr = ctx->get_link_snr(ctx, ctx->sta_array[sender],
+				ctx->sta_array[sum->dst_idx]);
+	if (snr < 0)
+		return;
+
+	sum->power += dBm_to_milliwatt(snr + NOISE_LEVEL);
+}
+
+/*
+ * Sum up the transmissions of other stations that overlap the last
+ * attempt of a frame, as heard by the receiver.
+ */
+static int get_signal_offset_by_overlap(struct wmediumd *ctx,
+					struct frame *frame, int dst_idx)
+{
+	struct overlap_power sum = {
+		.ctx = ctx,
+		.src_idx = frame->sender->index,
+		.dst_idx = dst_idx,
+		.power = 0.0,
+	};
+	u64 end;
+
+	if (!ctx->airtime || frame->airtime <= 0)
+		return 0;
+
+	end = timespec_to_usec(&frame->expires);
+	airtime_overlaps(ctx->airtime, end - frame->airtime, end,
+			 add_overlap_power, &sum);
+
+	if (sum.power <= 1.0)
+		return 0;
+
+	return (int)(milliwatt_to_dBm(sum.power) + 0.5);
+}
+
+/*
+ * Decide whether an acked unicast frame is lost to the transmissions that
+ * overlapped it.  The frame already survived its error probability
+ * without interference, so it is lost with the conditional probability of
+ * failing only because of the interference.
+ */
+static bool lost_by_overlap(struct wmediumd *ctx, struct frame *frame,
+			    struct station *station)
+{
+	struct rng_stream rng;
+	double error_prob, intf_error_prob;
+	int offset, snr, rate_idx = -1;
+	int i;
+
+	offset = get_signal_offset_by_overlap(ctx, frame, station->index);
+	if (offset <= 0)
+		return false;
+
+	for (i = 0; i < frame->tx_rates_count; i++) {
+		if (frame->tx_rates[i].idx < 0)
+			break;
+		rate_idx = frame->tx_rates[i].idx;
+	}
+	if (rate_idx < 0)
+		return false;
+
+	snr = frame->signal - NOISE_LEVEL;
+	error_prob = ctx->get_error_prob(ctx, snr, rate_idx, frame->data_len,
+					 frame->sender, station);
+	intf_error_prob = ctx->get_error_prob(ctx, snr - offset, rate_idx,
+					      frame->data_len, frame->sender,
+					      station);
+	if (intf_error_prob <= error_prob)
+		return false;
+	if (error_prob >= 1.0)
+		return true;
+
+	rng_stream_init(&rng, ctx->seed, frame->sender->index,
+			RNG_STREAM_OVERLAP(station->index), frame->seq);
+	return rng_stream_uniform(&rng) <
+		(intf_error_prob - error_prob) / (1.0 - error_prob);
+}
+
 bool is_multicast_ether_addr(const u8 *addr)
 {
 	return 0x01 & addr[0];
@@ -295,34 +471,584 @@ static struct station *get_station_by_addr(struct wmediumd *ctx, u8 *addr)
 	return NULL;
 }
 
+/*
+ * Number of failed attempts before the first success when every attempt
+ * fails with error_prob, capped at count (all attempts failed).  The
+ * count is drawn at once from its geometric distribution, which is the
+ * same distribution as flipping one coin per attempt.
+ */
+static int sample_failed_attempts(struct wmediumd *ctx, double error_prob,
+				  int count, double choice,
+				  struct rng_stream *rng)
+{
+	double k;
+
+	/* a fixed random value decides every attempt the same way */
+	if (use_fixed_random_value(ctx))
+		return choice > error_prob ? 0 : count;
+
+	if (error_prob <= 0.0)
+		return 0;
+	if (error_prob >= 1.0)
+		return count;
+
+	/* P(k >= n) = P(u <= error_prob^n) = error_prob^n, u in (0, 1] */
+	k = floor(log(1.0 - rng_stream_uniform(rng)) / log(error_prob));
+	return k < count ? (int)k : count;
+}
+
+/*
+ * Total backoff of n consecutive retries starting at contention window
+ * *cw, which is left at the window for the following retry.  The window
+ * saturates after a few doublings, the rest is a constant per retry.
+ */
+static int backoff_time(int *cw, int cw_max, int n, int slot_time)
+{
+	int t = 0;
+
+	while (n > 0 && *cw < cw_max) {
+		t += (*cw * slot_time) / 2;
+		*cw = (*cw << 1) + 1;
+		if (*cw > cw_max)
+			*cw = cw_max;
+		n--;
+	}
+
+	return t + n * ((cw_max * slot_time) / 2);
+}
+
+/*
+ * Find the medium of a channel, a channel gets its own medium when its
+ * first frame is queued.
+ */
+static struct medium *get_medium(struct wmediumd *ctx, int freq)
+{
+	struct medium *medium, **media;
+	int i;
+
+	for (i = 0; i < ctx->num_media; i++) {
+		if (ctx->media[i]->freq == freq)
+			return ctx->media[i];
+	}
+
+	media = realloc(ctx->media, (ctx->num_media + 1) * sizeof(*media));
+	if (!media)
+		return NULL;
+	ctx->media = media;
+
+	medium = calloc(1, sizeof(*medium));
+	if (!medium)
+		return NULL;
+	medium->freq = freq;
+
+	if (ctx->edca_contention) {
+		medium->edca = edca_create(ctx->num_stas * IEEE80211_NUM_ACS);
+		if (!medium->edca) {
+			free(medium);
+			return NULL;
+		}
+	}
+
+	ctx->media[ctx->num_media++] = medium;
+	w_logf(ctx, LOG_NOTICE, "Added medium for %d MHz\n", freq);
+	return medium;
+}
+
+/* TODO configure phy parameters */
+#define SLOT_TIME	(9)	/* [usec] */
+#define SIFS		(16)	/* [usec] */
+#define ACK_LEN			(14)	/* [bytes] */
+#define BLOCK_ACK_LEN		(32)	/* compressed, [bytes] */
+#define AMPDU_MAX_SUBFRAMES	(64)	/* block ack window */
+#define AMPDU_MAX_LEN		(65535)	/* [bytes] */
+
+static inline int contender_index(struct station *station, int ac)
+{
+	return station->index * IEEE80211_NUM_ACS + ac;
+}
+
+static inline bool frame_is_noack(struct frame *frame)
+{
+	struct ieee80211_hdr *hdr = (void *)frame->data;
+
+	return frame_is_mgmt(frame) || is_multicast_ether_addr(hdr->addr1);
+}
+
+/* whether a frame may follow another one in an A-MPDU */
+static bool frames_aggregate(struct frame *frame, struct frame *next)
+{
+	struct ieee80211_hdr *hdr = (void *)frame->data;
+	struct ieee80211_hdr *next_hdr = (void *)next->data;
+
+	if (!frame_is_data_qos(frame) || !frame_is_data_qos(next) ||
+	    is_multicast_ether_addr(hdr->addr1))
+		return false;
+
+	return frame->medium == next->medium &&
+	       memcmp(hdr->addr1, next_hdr->addr1, ETH_ALEN) == 0 &&
+	       (*frame_get_qos_ctl(frame) & QOS_CTL_TAG1D_MASK) ==
+	       (*frame_get_qos_ctl(next) & QOS_CTL_TAG1D_MASK);
+}
+
+/* the frame of a queue that contends for the medium */
+static struct frame *edca_next_frame(struct wqueue *queue)
+{
+	struct frame *frame;
+
+	list_for_each_entry(frame, &queue->frames, list) {
+		if (!frame->scheduled)
+			return frame;
+	}
+	return NULL;
+}
+
+/* move to the first usable rate at or after the current one */
+static bool edca_find_rate(struct frame *frame)
+{
+	struct hwsim_tx_rate *r;
+
+	for (; frame->rate_pos < frame->tx_rates_count; frame->rate_pos++) {
+		r = &frame->tx_rates[frame->rate_pos];
+		/* no more rates in MRR */
+		if (r->idx < 0)
+			return false;
+		if (index_to_rate[r->idx] != 0 && r->count != 0) {
+			frame->attempt = 0;
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Let the next frame of a queue contend on its medium with a backoff drawn
+ * from its contention window, once the queue is ready.  A queue that gets
+ * ready while others contend on the idle medium counts its AIFS and
+ * backoff from then, one that just sent on the medium joins the busy
+ * period.  The queue stops contending on the medium it
+ * contended on before unless the frame uses the same one.
+ */
+static void edca_contend_queue(struct station *station, int ac,
+			       struct medium *prev, u64 ready)
+{
+	struct wqueue *queue = &station->queues[ac];
+	struct frame *frame = edca_next_frame(queue);
+	struct medium *medium;
+	int backoff, late = 0;
+
+	if (prev && (!frame || frame->medium != prev))
+		edca_stop(prev->edca, contender_index(station, ac));
+	if (!frame)
+		return;
+
+	/* an idle medium starts the contention when the queue is ready */
+	medium = frame->medium;
+	if (!medium->edca->active && medium->free < ready)
+		medium->free = ready;
+	else if (medium != prev && medium->free < ready)
+		late = (ready - medium->free + SLOT_TIME - 1) / SLOT_TIME;
+
+	backoff = (int)(rng_stream_uniform(&frame->rng) * (frame->cw + 1));
+	edca_start(medium->edca, contender_index(station, ac), queue->aifsn,
+		   backoff, late);
+}
+
+/* report the attempts at the current rate as the last ones */
+static void edca_end_rates(struct frame *frame)
+{
+	int i;
+
+	frame->tx_rates[frame->rate_pos].count = frame->attempt;
+	for (i = frame->rate_pos + 1; i < frame->tx_rates_count; i++) {
+		frame->tx_rates[i].idx = -1;
+		frame->tx_rates[i].count = -1;
+	}
+}
+
+/* fix the delivery time of a frame whose last attempt ends at end */
+static void edca_schedule_frame(struct frame *frame, u64 end, bool acked)
+{
+	if (acked)
+		frame->flags |= HWSIM_TX_STAT_ACK;
+
+	frame->duration = frame->attempts ? (int)(end - frame->tx_start) : 0;
+	usec_to_timespec(end, &frame->expires);
+	frame->scheduled = true;
+}
+
+/*
+ * Account one attempt of the contending frame of a queue that went on
+ * the air from start to end, and let the queue contend again.
+ */
+static void edca_attempt_done(struct station *station, int ac,
+			      struct frame *frame, u64 start, u64 end,
+			      bool success)
+{
+	struct wqueue *queue = &station->queues[ac];
+	struct medium *medium = frame->medium;
+
+	if (!frame->attempts)
+		frame->tx_start = start;
+	frame->attempts++;
+	frame->attempt++;
+
+	/*
+	 * A frame without an ack that went on the air and collided is lost,
+	 * it is not retried.  Only an internal collision kept it off the air.
+	 */
+	if (success || (frame_is_noack(frame) && end > start)) {
+		edca_end_rates(frame);
+		edca_schedule_frame(frame, end, success);
+		edca_contend_queue(station, ac, medium, end);
+		return;
+	}
+
+	if (frame->attempt >= frame->tx_rates[frame->rate_pos].count) {
+		frame->rate_pos++;
+		if (!edca_find_rate(frame)) {
+			edca_schedule_frame(frame, end, false);
+			edca_contend_queue(station, ac, medium, end);
+			return;
+		}
+	}
+
+	frame->cw = (frame->cw << 1) + 1;
+	if (frame->cw > queue->cw_max)
+		frame->cw = queue->cw_max;
+	edca_contend_queue(station, ac, medium, end);
+}
+
+/* decide whether an attempt of a frame at its current rate gets through */
+static bool edca_attempt_succeeds(struct wmediumd *ctx,
+				  struct station *station, struct frame *frame,
+				  bool collision)
+{
+	int rate_idx = frame->tx_rates[frame->rate_pos].idx;
+	double error_prob, choice;
+
+	if (collision)
+		return false;
+	if (frame_is_noack(frame))
+		return true;
+	if (frame->receiver &&
+	    !freq_matches(frame->receiver->freq, frame->freq))
+		return false;
+
+	error_prob = ctx->get_error_prob(ctx, frame->signal - NOISE_LEVEL,
+					 rate_idx, frame->data_len, station,
+					 frame->receiver);
+	choice = use_fixed_random_value(ctx) ? frame->choice :
+		rng_stream_uniform(&frame->rng);
+	return choice > error_prob;
+}
+
+/*
+ * Append the following frames of a queue for the same receiver and TID
+ * to the A-MPDU of a frame that went on the air from start until end.
+ * Every subframe succeeds or fails on its own.
+ * Returns the end of the A-MPDU.
+ */
+static u64 edca_aggregate(struct wmediumd *ctx, struct station *station,
+			  int ac, struct frame *frame, u64 start, u64 end,
+			  bool collision)
+{
+	struct wqueue *queue = &station->queues[ac];
+	int rate_idx = frame->tx_rates[frame->rate_pos].idx;
+	int num = 1, len = frame->data_len;
+	struct frame *next = frame;
+
+	list_for_each_entry_continue(next, &queue->frames, list) {
+		if (next->scheduled)
+			continue;
+		if (!frames_aggregate(frame, next) ||
+		    next->tx_rates[next->rate_pos].idx != rate_idx ||
+		    num >= AMPDU_MAX_SUBFRAMES ||
+		    len + next->data_len > AMPDU_MAX_LEN)
+			break;
+
+		next->airtime = ampdu_subframe_duration(next->data_len,
+						index_to_rate[rate_idx]);
+		edca_attempt_done(station, ac, next, start,
+				  end + next->airtime,
+				  edca_attempt_succeeds(ctx, station, next,
+							collision));
+		end += next->airtime;
+		num++;
+		len += next->data_len;
+	}
+	return end;
+}
+
+/*
+ * Send the contending frame of a queue that won a contention round at
+ * start, alone or colliding with the frames of other stations.
+ */
+static u64 edca_transmit(struct wmediumd *ctx, struct station *station,
+			 int ac, struct frame *frame, u64 start,
+			 bool collision)
+{
+	int rate_idx = frame->tx_rates[frame->rate_pos].idx;
+	int ack_time_usec = pkt_duration(ACK_LEN, index_to_rate[0]) + SIFS;
+	int ba_time_usec = pkt_duration(BLOCK_ACK_LEN, index_to_rate[0]) + SIFS;
+	u64 end, mpdu_end;
+
+	frame->airtime = pkt_duration(frame->data_len,
+				      index_to_rate[rate_idx]);
+	end = mpdu_end = start + frame->airtime;
+
+	edca_attempt_done(station, ac, frame, start, end,
+			  edca_attempt_succeeds(ctx, station, frame,
+						collision));
+	if (ctx->aggregation)
+		end = edca_aggregate(ctx, station, ac, frame, start, end,
+				     collision);
+
+	if (ctx->airtime &&
+	    airtime_insert(ctx->airtime, start, end, station->index))
+		w_logf(ctx, LOG_ERR, "Out of memory(airtime)\n");
+
+	/* the medium is busy until the (block) ack was sent or timed out */
+	if (frame_is_noack(frame))
+		return end;
+	return end + (end > mpdu_end ? ba_time_usec : ack_time_usec);
+}
+
+/*
+ * Send the following frames of a queue that won the medium at start and
+ * sent its frame until end, SIFS apart and without contending again,
+ * while they are acked and fit into the TXOP of the queue.
+ * Returns the time the medium is busy until.
+ */
+static u64 edca_txop_burst(struct wmediumd *ctx, struct station *station,
+			   int ac, struct frame *frame, u64 start, u64 end)
+{
+	struct wqueue *queue = &station->queues[ac];
+	struct medium *medium = frame->medium;
+	int ack_time_usec = pkt_duration(ACK_LEN, index_to_rate[0]) + SIFS;
+	int rate_idx;
+	u64 busy;
+
+	if (!queue->txop_limit)
+		return end;
+
+	while (frame->scheduled && (frame->flags & HWSIM_TX_STAT_ACK)) {
+		frame = edca_next_frame(queue);
+		if (!frame || frame->medium != medium)
+			break;
+
+		rate_idx = frame->tx_rates[frame->rate_pos].idx;
+		busy = end + SIFS + pkt_duration(frame->data_len,
+						 index_to_rate[rate_idx]);
+		if (!frame_is_noack(frame))
+			busy += ack_time_usec;
+		if (busy > start + queue->txop_limit)
+			break;
+
+		edca_stop(medium->edca, contender_index(station, ac));
+		end = edca_transmit(ctx, station, ac, frame, end + SIFS,
+				    false);
+	}
+	return end;
+}
+
+/*
+ * Run the contention rounds that start until now and note when the next
+ * one starts.  Each round skips the idle slots up to the first expiring
+ * backoff at once, a round is only decided once that backoff expired so
+ * queues that get ready in between still take part.  The queues that
+ * expire together collide unless they belong to the same station, where
+ * the highest priority queue sends and the others back off again.  A
+ * queue that won alone may go on sending within its TXOP.
+ */
+static void edca_run(struct wmediumd *ctx, struct medium *medium, u64 now)
+{
+	struct edca *edca = medium->edca;
+	struct station *station;
+	struct frame *frame;
+	int idx, sta_idx, ac, slots, senders, last;
+	u64 start, end, t;
+
+	for (;;) {
+		slots = edca_next_round(edca);
+		if (slots == EDCA_IDLE)
+			break;
+
+		start = medium->free + SIFS + (u64)slots * SLOT_TIME;
+		medium->next_round = start;
+		if (start > now)
+			break;
+
+		edca_contend(edca, slots);
+
+		senders = 0;
+		last = -1;
+		for (idx = edca_next_winner(edca, 0); idx >= 0;
+		     idx = edca_next_winner(edca, idx + 1)) {
+			sta_idx = idx / IEEE80211_NUM_ACS;
+			if (sta_idx != last)
+				senders++;
+			last = sta_idx;
+		}
+
+		end = start;
+		last = -1;
+		for (idx = edca_next_winner(edca, 0); idx >= 0;
+		     idx = edca_next_winner(edca, idx + 1)) {
+			sta_idx = idx / IEEE80211_NUM_ACS;
+			ac = idx % IEEE80211_NUM_ACS;
+			station = ctx->sta_array[sta_idx];
+			frame = edca_next_frame(&station->queues[ac]);
+
+			if (sta_idx == last) {
+				/* internal collision, no airtime */
+				edca_attempt_done(station, ac, frame,
+						  start, start, false);
+				continue;
+			}
+			last = sta_idx;
+
+			t = edca_transmit(ctx, station, ac, frame, start,
+					  senders > 1);
+			if (senders == 1)
+				t = edca_txop_burst(ctx, station, ac, frame,
+						    start, t);
+			if (t > end)
+				end = t;
+		}
+
+		medium->free = end;
+	}
+}
+
+/*
+ * Queue a frame to contend for the medium with the edca engine, its
+ * delivery time is only known once it was sent.
+ */
+static void queue_frame_edca(struct wmediumd *ctx, struct station *station,
+			     struct frame *frame, int ac,
+			     struct station *deststa, struct rng_stream *rng,
+			     double choice, struct timespec *now)
+{
+	struct wqueue *queue = &station->queues[ac];
+	struct medium *medium = frame->medium;
+	u64 now_usec = timespec_to_usec(now);
+	bool contending;
+
+	if (contender_index(station, IEEE80211_NUM_ACS) > medium->edca->num &&
+	    edca_resize(medium->edca, ctx->num_stas * IEEE80211_NUM_ACS)) {
+		w_logf(ctx, LOG_ERR, "Out of memory(edca)\n");
+		free(frame);
+		return;
+	}
+
+	edca_run(ctx, medium, now_usec);
+	contending = edca_next_frame(queue) != NULL;
+
+	frame->receiver = deststa;
+	frame->rng = *rng;
+	frame->choice = choice;
+	frame->rate_pos = 0;
+	frame->attempt = 0;
+	frame->attempts = 0;
+	frame->cw = queue->cw_min;
+	frame->airtime = 0;
+	frame->duration = 0;
+	frame->scheduled = false;
+	list_add_tail(&frame->list, &queue->frames);
+
+	if (!edca_find_rate(frame)) {
+		edca_schedule_frame(frame, now_usec, false);
+	} else if (!contending) {
+		edca_contend_queue(station, ac, NULL, now_usec);
+		edca_run(ctx, medium, now_usec);
+	}
+
+	rearm_timer(ctx);
+}
+
+/*
+ * Get the stations a station hears above the CCA threshold and therefore
+ * waits for.  The sets are rebuilt when the links changed.
+ * Returns the number of stations or -1 if the set is not available.
+ */
+static int get_cca_neighbors(struct wmediumd *ctx, struct station *station,
+			     struct station ***neighbors)
+{
+	unsigned long epoch = __atomic_load_n(&ctx->link_epoch,
+					      __ATOMIC_ACQUIRE);
+	struct station **set, *other;
+	int snr;
+
+	if (station->cca_epoch != epoch || !station->cca_neighbors) {
+		set = realloc(station->cca_neighbors,
+			      (ctx->num_stas + 1) * sizeof(*set));
+		if (!set)
+			return -1;
+		station->cca_neighbors = set;
+		station->cca_num = 0;
+
+		list_for_each_entry(other, &ctx->stations, list) {
+			if (other == station)
+				continue;
+			snr = ctx->get_link_snr(ctx, other, station);
+			if (snr + NOISE_LEVEL >= CCA_THRESHOLD)
+				set[station->cca_num++] = other;
+		}
+		station->cca_epoch = epoch;
+	}
+
+	*neighbors = station->cca_neighbors;
+	return station->cca_num;
+}
+
+/* delay target until the last frame of a queue on a medium was sent */
+static void defer_to_queue_tail(struct wqueue *queue, struct medium *medium,
+				struct timespec *target)
+{
+	struct frame *tail;
+
+	tail = list_last_entry_or_null(&queue->frames, struct frame, list);
+	if (tail && tail->medium == medium &&
+	    timespec_before(target, &tail->expires))
+		*target = tail->expires;
+}
+
 void queue_frame(struct wmediumd *ctx, struct station *station,
 		 struct frame *frame)
 {
 	struct ieee80211_hdr *hdr = (void *)frame->data;
 	u8 *dest = hdr->addr1;
-	struct timespec now, target;
+	struct timespec now, target, txop_end;
 	struct wqueue *queue;
+	struct medium *medium;
+	struct station *deststa;
 	struct frame *tail;
-	struct station *tmpsta, *deststa;
+	struct station **neighbors;
+	int num_neighbors, k;
 	int send_time;
 	int cw;
 	double error_prob;
 	bool is_acked = false;
 	bool noack = false;
-	int i, j;
-	int rate_idx;
+	bool ampdu, aggregated;
+	int first_rate = -1;
+	int i, j = 0;
+	int rate_idx, rate;
+	int count, attempts;
 	int ac;
+	int airtime = 0;
+	struct rng_stream rng;
 
-	/* TODO configure phy parameters */
-	int slot_time = 9;
-	int sifs = 16;
+	int slot_time = SLOT_TIME;
+	int sifs = SIFS;
 	int difs = 2 * slot_time + sifs;
 
 	int retries = 0;
 
 	clock_gettime(CLOCK_MONOTONIC, &now);
 
-	int ack_time_usec = pkt_duration(14, index_to_rate[0]) + sifs;
+	int ack_time_usec = pkt_duration(ACK_LEN, index_to_rate[0]) + sifs;
+	int ba_time_usec = pkt_duration(BLOCK_ACK_LEN, index_to_rate[0]) + sifs;
 
 	/*
 	 * To determine a frame's expiration time, we compute the
@@ -334,22 +1060,36 @@ void queue_frame(struct wmediumd *ctx, struct station *station,
 	ac = frame_select_queue_80211(frame);
 	queue = &station->queues[ac];
 
+	medium = get_medium(ctx, frame->freq);
+	if (!medium) {
+		w_logf(ctx, LOG_ERR, "Out of memory(medium)\n");
+		free(frame);
+		return;
+	}
+	frame->medium = medium;
+
 	/* try to "send" this frame at each of the rates in the rateset */
 	send_time = 0;
 	cw = queue->cw_min;
 
 	int snr = SNR_DEFAULT;
 
-	if (is_multicast_ether_addr(dest)) {
+	frame->seq = station->tx_seq++;
+
+	if (is_multicast_ether_addr(dest))
 		deststa = NULL;
-	} else {
+	else
 		deststa = get_station_by_addr(ctx, dest);
-		if (deststa) {
-			snr = ctx->get_link_snr(ctx, station, deststa) -
-				get_signal_offset_by_interference(ctx,
-					station->index, deststa->index);
-			snr += ctx->get_fading_signal(ctx);
-		}
+
+	rng_stream_init(&rng, ctx->seed, station->index,
+			deststa ? (u32)deststa->index : RNG_STREAM_MCAST,
+			frame->seq);
+
+	if (deststa) {
+		snr = ctx->get_link_snr(ctx, station, deststa) -
+			get_signal_offset_by_interference(ctx,
+				station->index, deststa->index, &rng);
+		snr += ctx->get_fading_signal(ctx, station, deststa, &rng);
 	}
 	frame->signal = snr + NOISE_LEVEL;
 
@@ -357,7 +1097,49 @@ void queue_frame(struct wmediumd *ctx, struct station *station,
 	double choice = -3.14;
 
 	if (use_fixed_random_value(ctx))
-		choice = drand48();
+		choice = rng_stream_uniform(&rng);
+
+	if (medium->edca) {
+		queue_frame_edca(ctx, station, frame, ac, deststa, &rng,
+				 choice, &now);
+		return;
+	}
+
+	/*
+	 * delivery time starts after any equal or higher prio frame
+	 * on the same channel of a station within CCA range (or now, if
+	 * none).  Frames of a queue are delivered in order, so the latest
+	 * delivery on the medium is the latest queue tail.
+	 */
+	target = now;
+	num_neighbors = get_cca_neighbors(ctx, station, &neighbors);
+	if (num_neighbors < 0 || num_neighbors == ctx->num_stas - 1) {
+		for (i = 0; i <= ac; i++) {
+			if (timespec_before(&target, &medium->tail[i]))
+				target = medium->tail[i];
+		}
+	} else {
+		for (i = 0; i <= ac; i++) {
+			defer_to_queue_tail(&station->queues[i], medium,
+					    &target);
+			for (k = 0; k < num_neighbors; k++)
+				defer_to_queue_tail(&neighbors[k]->queues[i],
+						    medium, &target);
+		}
+	}
+
+	/*
+	 * A QoS data frame joins the A-MPDU of the tail of its queue if
+	 * that one is not on the air yet and nobody else sends in between.
+	 */
+	tail = list_last_entry_or_null(&queue->frames, struct frame, list);
+	ampdu = ctx->aggregation && tail && queue->ampdu_num &&
+		timespec_before(&now, &queue->ampdu_start) &&
+		!timespec_before(&tail->expires, &target) &&
+		queue->ampdu_num < AMPDU_MAX_SUBFRAMES &&
+		queue->ampdu_len + frame->data_len <= AMPDU_MAX_LEN &&
+		frames_aggregate(tail, frame);
+	aggregated = false;
 
 	for (i = 0; i < frame->tx_rates_count && !is_acked; i++) {
 
@@ -367,40 +1149,70 @@ void queue_frame(struct wmediumd *ctx, struct station *station,
 		if (rate_idx < 0)
 			break;
 
-		error_prob = ctx->get_error_prob(ctx, snr, rate_idx,
-						 frame->data_len, station,
-						 deststa);
-		for (j = 0; j < frame->tx_rates[i].count; j++) {
-			int rate = index_to_rate[rate_idx];
-			if (rate == 0) // avoid division by zero
-				continue;
-			send_time += difs + pkt_duration(frame->data_len, rate);
-
-			retries++;
+		rate = index_to_rate[rate_idx];
+		count = frame->tx_rates[i].count;
+		if (rate == 0 || count == 0) // avoid division by zero
+			continue;
 
-			/* skip ack/backoff/retries for noack frames */
-			if (noack) {
-				is_acked = true;
-				break;
-			}
+		airtime = pkt_duration(frame->data_len, rate);
 
-			/* TODO TXOPs */
+		/* skip ack/backoff/retries for noack frames */
+		if (noack) {
+			send_time += difs + airtime;
+			retries++;
+			is_acked = true;
+			j = 0;
+			continue;
+		}
 
-			/* backoff */
-			if (j > 0) {
-				send_time += (cw * slot_time) / 2;
-				cw = (cw << 1) + 1;
-				if (cw > queue->cw_max)
-					cw = queue->cw_max;
-			}
-			if (!use_fixed_random_value(ctx))
-				choice = drand48();
-			if (choice > error_prob) {
-				is_acked = true;
-				break;
-			}
-			send_time += ack_time_usec;
+		/* a receiver on another channel never acks */
+		if (deststa && !freq_matches(deststa->freq, frame->freq))
+			error_prob = 1.0;
+		else
+			error_prob = ctx->get_error_prob(ctx, snr, rate_idx,
+							 frame->data_len,
+							 station, deststa);
+
+		/*
+		 * j is the index of the first successful attempt at this
+		 * rate, or count if every attempt failed.  Every attempt but
+		 * the first one backs off, every failed one waits for the ack.
+		 */
+		j = sample_failed_attempts(ctx, error_prob, count, choice,
+					   &rng);
+		attempts = j < count ? j + 1 : count;
+
+		send_time += attempts *
+			(difs + pkt_duration(frame->data_len, rate));
+		send_time += backoff_time(&cw, queue->cw_max, attempts - 1,
+					  slot_time);
+		send_time += (j < count ? j : count) * ack_time_usec;
+		retries += attempts;
+
+		/*
+		 * The first attempt of a subframe only adds its symbols to
+		 * the A-MPDU, a failure shows in the shared block ack.  With
+		 * its second subframe the A-MPDU is answered by a block ack
+		 * instead of an ack.
+		 */
+		if (ampdu && rate_idx == queue->ampdu_rate) {
+			send_time -= difs + airtime;
+			send_time += ampdu_subframe_duration(frame->data_len,
+							     rate);
+			if (queue->ampdu_num == 1)
+				send_time += ba_time_usec - ack_time_usec;
+			if (j)
+				send_time -= ack_time_usec;
+			else
+				airtime = ampdu_subframe_duration(
+					frame->data_len, rate);
+			aggregated = !j;
 		}
+		ampdu = false;
+		first_rate = first_rate < 0 ? rate_idx : first_rate;
+
+		if (j < count)
+			is_acked = true;
 	}
 
 	if (is_acked) {
@@ -413,23 +1225,54 @@ void queue_frame(struct wmediumd *ctx, struct station *station,
 	}
 
 	/*
-	 * delivery time starts after any equal or higher prio frame
-	 * (or now, if none).
+	 * A frame that follows the acked tail of its queue before anyone
+	 * else took the medium continues the TXOP of the queue as long as
+	 * it fits, its first attempt only waits SIFS instead of DIFS.
 	 */
-	target = now;
-	for (i = 0; i <= ac; i++) {
-		list_for_each_entry(tmpsta, &ctx->stations, list) {
-			tail = list_last_entry_or_null(&tmpsta->queues[i].frames,
-						       struct frame, list);
-			if (tail && timespec_before(&target, &tail->expires))
-				target = tail->expires;
+	if (queue->txop_limit && send_time >= difs && !aggregated) {
+		txop_end = target;
+		timespec_add_usec(&txop_end, send_time - (difs - sifs));
+		if (tail && tail->medium == medium &&
+		    (tail->flags & HWSIM_TX_STAT_ACK) &&
+		    !timespec_before(&tail->expires, &target) &&
+		    !timespec_before(&queue->txop_end, &txop_end)) {
+			send_time -= difs - sifs;
+		} else {
+			queue->txop_end = target;
+			timespec_add_usec(&queue->txop_end, queue->txop_limit);
 		}
 	}
 
+	if (aggregated) {
+		queue->ampdu_num++;
+		queue->ampdu_len += frame->data_len;
+	} else if (ctx->aggregation && is_acked && retries == 1 && !noack &&
+		   frame_is_data_qos(frame)) {
+		queue->ampdu_start = target;
+		queue->ampdu_num = 1;
+		queue->ampdu_len = frame->data_len;
+		queue->ampdu_rate = first_rate;
+	} else {
+		queue->ampdu_num = 0;
+	}
+
+	/*
+	 * A sender hidden from the latest one may end earlier, the tail
+	 * keeps the latest end for the stations that hear both.
+	 */
 	timespec_add_usec(&target, send_time);
+	if (timespec_before(&medium->tail[ac], &target))
+		medium->tail[ac] = target;
 
 	frame->duration = send_time;
+	frame->airtime = airtime;
 	frame->expires = target;
+	frame->scheduled = true;
+
+	if (ctx->airtime && airtime > 0 &&
+	    airtime_insert(ctx->airtime, timespec_to_usec(&target) - airtime,
+			   timespec_to_usec(&target), station->index))
+		w_logf(ctx, LOG_ERR, "Out of memory(airtime)\n");
 	list_add_tail(&frame->list, &queue->frames);
 	rearm_timer(ctx);
 }
@@ -485,9 +1328,11 @@ out:
 
 /*
  * Send a data frame to the kernel for reception at a specific radio.
+ * The kernel drops it if the radio is tuned to another channel than freq.
  */
 int send_cloned_frame_msg(struct wmediumd *ctx, struct station *dst,
-			  u8 *data, int data_len, int rate_idx, int signal)
+			  u8 *data, int data_len, int rate_idx, int signal,
+			  int freq)
 {
 	struct nl_msg *msg;
 	struct nl_sock *sock = ctx->sock;
@@ -511,7 +1356,9 @@ int send_cloned_frame_msg(struct wmediumd *ctx, struct station *dst,
 		    dst->hwaddr) ||
 	    nla_put(msg, HWSIM_ATTR_FRAME, data_len, data) ||
 	    nla_put_u32(msg, HWSIM_ATTR_RX_RATE, 1) ||
-	    nla_put_u32(msg, HWSIM_ATTR_SIGNAL, signal)) {
+	    nla_put_u32(msg, HWSIM_ATTR_SIGNAL, signal) ||
+	    (freq != FREQ_UNKNOWN &&
+	     nla_put_u32(msg, HWSIM_ATTR_FREQ, freq))) {
 		w_logf(ctx, LOG_ERR, "%s: Failed to fill a payload\n", __func__);
 		ret = -1;
 		goto out;
@@ -533,6 +1380,73 @@ out:
 	return ret;
 }
 
+static void deliver_multicast_frame(struct wmediumd *ctx, struct frame *frame,
+				    struct station *station)
+{
+	int snr, rate_idx, signal;
+	double error_prob;
+	struct rng_stream rng;
+
+	/*
+	 * we may or may not receive this based on
+	 * reverse link from sender -- check for
+	 * each receiver.
+	 */
+	rng_stream_init(&rng, ctx->seed, frame->sender->index,
+			station->index, frame->seq);
+	snr = ctx->get_link_snr(ctx, frame->sender, station);
+	snr += ctx->get_fading_signal(ctx, frame->sender, station, &rng);
+	signal = snr + NOISE_LEVEL;
+
+	if (set_interference_duration(ctx, frame->sender->index,
+				      frame->duration, signal))
+		return;
+
+	snr -= get_signal_offset_by_interference(ctx, frame->sender->index,
+						 station->index, &rng);
+	snr -= get_signal_offset_by_overlap(ctx, frame, station->index);
+	rate_idx = frame->tx_rates[0].idx;
+	error_prob = ctx->get_error_prob(ctx, (double)snr, rate_idx,
+					 frame->data_len, frame->sender,
+					 station);
+
+	if (rng_stream_uniform(&rng) <= error_prob) {
+		w_logf(ctx, LOG_INFO, "Dropped mcast from "
+			   MAC_FMT " to " MAC_FMT " at receiver\n",
+			   MAC_ARGS(frame->sender->addr),
+			   MAC_ARGS(station->addr));
+		return;
+	}
+
+	send_cloned_frame_msg(ctx, station, frame->data, frame->data_len,
+			      1, signal, frame->freq);
+}
+
+/*
+ * Deliver a multicast frame only to the stations in range of the sender.
+ * The others would only have counted it as interference.
+ */
+static void deliver_multicast_frame_reachable(struct wmediumd *ctx,
+					      struct frame *frame)
+{
+	struct station *station;
+	const int *reachable;
+	int i, num;
+
+	reachable = ctx->get_reachable_stations(ctx, frame->sender, &num);
+	if (num < ctx->num_stas - 1)
+		set_interference_duration(ctx, frame->sender->index,
+					  frame->duration,
+					  SNR_UNREACHABLE + NOISE_LEVEL);
+
+	for (i = 0; i < num; i++) {
+		station = ctx->sta_array[reachable[i]];
+		if (memcmp(frame->sender->addr, station->addr, ETH_ALEN) == 0)
+			continue;
+		deliver_multicast_frame(ctx, frame, station);
+	}
+}
+
 void deliver_frame(struct wmediumd *ctx, struct frame *frame)
 {
 	struct ieee80211_hdr *hdr = (void *) frame->data;
@@ -541,65 +1455,48 @@ void deliver_frame(struct wmediumd *ctx, struct frame *frame)
 	u8 *src = frame->sender->addr;
 
 	if (frame->flags & HWSIM_TX_STAT_ACK) {
+		if (is_multicast_ether_addr(dest) &&
+		    ctx->get_reachable_stations) {
+			deliver_multicast_frame_reachable(ctx, frame);
+			goto out;
+		}
+
 		/* rx the frame on the dest interface */
 		list_for_each_entry(station, &ctx->stations, list) {
 			if (memcmp(src, station->addr, ETH_ALEN) == 0)
 				continue;
 
 			if (is_multicast_ether_addr(dest)) {
-				int snr, rate_idx, signal;
-				double error_prob;
-
-				/*
-				 * we may or may not receive this based on
-				 * reverse link from sender -- check for
-				 * each receiver.
-				 */
-				snr = ctx->get_link_snr(ctx, frame->sender,
-							station);
-				snr += ctx->get_fading_signal(ctx);
-				signal = snr + NOISE_LEVEL;
-
+				deliver_multicast_frame(ctx, frame, station);
+			} else if (memcmp(dest, station->addr, ETH_ALEN) == 0) {
 				if (set_interference_duration(ctx,
 					frame->sender->index, frame->duration,
-					signal))
+					frame->signal))
 					continue;
 
-				snr -= get_signal_offset_by_interference(ctx,
-					frame->sender->index, station->index);
-				rate_idx = frame->tx_rates[0].idx;
-				error_prob = ctx->get_error_prob(ctx,
-					(double)snr, rate_idx, frame->data_len,
-					frame->sender, station);
-
-				if (drand48() <= error_prob) {
-					w_logf(ctx, LOG_INFO, "Dropped mcast from "
-						   MAC_FMT " to " MAC_FMT " at receiver\n",
-						   MAC_ARGS(src), MAC_ARGS(station->addr));
+				if (ctx->airtime &&
+				    lost_by_overlap(ctx, frame, station)) {
+					w_logf(ctx, LOG_INFO, "Dropped frame from "
+					       MAC_FMT " to " MAC_FMT
+					       " by overlapping transmissions\n",
+					       MAC_ARGS(src),
+					       MAC_ARGS(station->addr));
+					frame->flags &= ~HWSIM_TX_STAT_ACK;
 					continue;
 				}
 
 				send_cloned_frame_msg(ctx, station,
 						      frame->data,
 						      frame->data_len,
-						      1, signal);
-
-			} else if (memcmp(dest, station->addr, ETH_ALEN) == 0) {
-				if (set_interference_duration(ctx,
-					frame->sender->index, frame->duration,
-					frame->signal))
-					continue;
-
-				send_cloned_frame_msg(ctx, station,
-						      frame->data,
-						      frame->data_len,
-						      1, frame->signal);
+						      1, frame->signal,
+						      frame->freq);
 			}
 		}
 	} else
 		set_interference_duration(ctx, frame->sender->index,
 					  frame->duration, frame->signal);
 
+out:
 	send_tx_info_frame_nl(ctx, frame);
 
 	free(frame);
@@ -612,7 +1509,8 @@ void deliver_expired_frames_queue(struct wmediumd *ctx,
 	struct frame *frame, *tmp;
 
 	list_for_each_entry_safe(frame, tmp, queue, list) {
-		if (timespec_before(&frame->expires, now)) {
+		if (frame->scheduled &&
+		    timespec_before(&frame->expires, now)) {
 			list_del(&frame->list);
 			deliver_frame(ctx, frame);
 		} else {
@@ -621,14 +1519,49 @@ void deliver_expired_frames_queue(struct wmediumd *ctx,
 	}
 }
 
+/*
+ * Forget the transmissions that ended before every queued frame starts,
+ * they cannot overlap any frame delivered later.
+ */
+static void prune_airtime(struct wmediumd *ctx, struct timespec *now)
+{
+	struct station *station;
+	struct frame *head;
+	u64 horizon, start;
+	int i;
+
+	horizon = timespec_to_usec(now);
+	list_for_each_entry(station, &ctx->stations, list) {
+		for (i = 0; i < IEEE80211_NUM_ACS; i++) {
+			head = list_first_entry_or_null(
+				&station->queues[i].frames, struct frame, list);
+			/* frames still contending are sent after now */
+			if (!head || !head->scheduled)
+				continue;
+			start = timespec_to_usec(&head->expires) -
+				head->duration;
+			if (start < horizon)
+				horizon = start;
+		}
+	}
+
+	airtime_prune(ctx->airtime, horizon);
+}
+
 void deliver_expired_frames(struct wmediumd *ctx)
 {
 	struct timespec now, _diff;
 	struct station *station;
 	struct list_head *l;
-	int i, j, duration;
+	int i, k, duration;
+	int *active;
 
 	clock_gettime(CLOCK_MONOTONIC, &now);
+	for (i = 0; i < ctx->num_media; i++) {
+		if (ctx->media[i]->edca)
+			edca_run(ctx, ctx->media[i], timespec_to_usec(&now));
+	}
+
 	list_for_each_entry(station, &ctx->stations, list) {
 		int q_ct[IEEE80211_NUM_ACS] = {};
 		for (i = 0; i < IEEE80211_NUM_ACS; i++) {
@@ -647,25 +1580,36 @@ void deliver_expired_frames(struct wmediumd *ctx)
 	}
 	w_logf(ctx, LOG_DEBUG, "\n\n");
 
+	if (ctx->airtime)
+		prune_airtime(ctx, &now);
+
 	if (!ctx->intf)
 		return;
 
 	timespec_sub(&now, &ctx->intf_updated, &_diff);
 	duration = (_diff.tv_sec * 1000000) + (_diff.tv_nsec / 1000);
-	if (duration < 10000) // calc per 10 msec
+	if (duration < ctx->intf_window)
 		return;
 
-	// update interference
-	for (i = 0; i < ctx->num_stas; i++)
-		for (j = 0; j < ctx->num_stas; j++) {
-			if (i == j)
-				continue;
-			// probability is used for next calc
-			ctx->intf[i * ctx->num_stas + j].prob_col =
-				ctx->intf[i * ctx->num_stas + j].duration /
-				(double)duration;
-			ctx->intf[i * ctx->num_stas + j].duration = 0;
-		}
+	/*
+	 * Update interference.  Only the stations that were on the air in
+	 * the last or in this window have a probability to change.
+	 */
+	for (k = 0; k < ctx->intf_num_active; k++)
+		ctx->intf[ctx->intf_active[k]].prob_col = 0.0;
+
+	for (k = 0; k < ctx->intf_num_dirty; k++) {
+		i = ctx->intf_dirty[k];
+		// probability is used for next calc
+		ctx->intf[i].prob_col = ctx->intf[i].duration / (double)duration;
+		ctx->intf[i].duration = 0;
+	}
+
+	active = ctx->intf_active;
+	ctx->intf_active = ctx->intf_dirty;
+	ctx->intf_num_active = ctx->intf_num_dirty;
+	ctx->intf_dirty = active;
+	ctx->intf_num_dirty = 0;
 
 	clock_gettime(CLOCK_MONOTONIC, &ctx->intf_updated);
 }
@@ -745,6 +1689,18 @@ static int process_messages_cb(struct nl_msg *msg, void *arg)
 				tx_rates_len / sizeof(struct hwsim_tx_rate);
 			memcpy(frame->tx_rates, tx_rates,
 			       min(tx_rates_len, sizeof(frame->tx_rates)));
+
+			/*
+			 * The radio is tuned to the channel it sends on, but
+			 * for probe requests that scan other channels.
+			 */
+			frame->freq = sender->freq;
+			if (attrs[HWSIM_ATTR_FREQ]) {
+				frame->freq = nla_get_u32(attrs[HWSIM_ATTR_FREQ]);
+				if (!frame_is_probe_req(frame))
+					sender->freq = frame->freq;
+			}
+
 			queue_frame(ctx, sender, frame);
 		}
 out:
@@ -842,7 +1798,7 @@ static int init_netlink(struct wmediumd *ctx)
 void print_help(int exval)
 {
 	printf("wmediumd v%s - a wireless medium simulator\n", VERSION_STR);
-	printf("wmediumd [-h] [-V] [-s] [-l LOG_LVL] [-x FILE] -c FILE\n\n");
+	printf("wmediumd [-h] [-V] [-s] [-l LOG_LVL] [-x FILE] [-S SEED] -c FILE\n\n");
 
 	printf("  -h              print this help and exit\n");
 	printf("  -V              print version and exit\n\n");
@@ -855,6 +1811,8 @@ void print_help(int exval)
 	printf("                  == 7: all packets will be logged\n");
 	printf("  -c FILE         set input config file\n");
 	printf("  -x FILE         set input PER file\n");
+	printf("  -S SEED         seed the random decisions (default: random)\n");
+	printf("                  runs with the same seed and traffic are reproducible\n");
 	printf("  -s              start the server on a socket\n");
 	printf("  -d              use the dynamic complex mode\n");
 	printf("                  (server only with matrices for each connection)\n");
@@ -875,7 +1833,7 @@ static void timer_cb(int fd, short what, void *data)
 
 int main(int argc, char *argv[])
 {
-	int opt;
+	int opt, i;
 	struct event ev_cmd;
 	struct event ev_timer;
 	struct wmediumd ctx;
@@ -894,8 +1852,10 @@ int main(int argc, char *argv[])
 	char* parse_end_token;
 	bool start_server = false;
 	bool full_dynamic = false;
+	bool seed_set = false;
+	unsigned long long parse_seed;
 
-	while ((opt = getopt(argc, argv, "hVc:l:x:sd")) != -1) {
+	while ((opt = getopt(argc, argv, "hVc:l:x:S:sd")) != -1) {
 		switch (opt) {
 		case 'h':
 			print_help(EXIT_SUCCESS);
@@ -927,6 +1887,18 @@ int main(int argc, char *argv[])
 			}
 			ctx.log_lvl = parse_log_lvl;
 			break;
+		case 'S':
+			errno = 0;
+			parse_seed = strtoull(optarg, &parse_end_token, 0);
+			if (errno == ERANGE || optarg == parse_end_token ||
+			    *parse_end_token != '\0') {
+				printf("wmediumd: Error - Invalid seed: "
+							   "%s\n\n", optarg);
+				print_help(EXIT_FAILURE);
+			}
+			ctx.seed = parse_seed;
+			seed_set = true;
+			break;
 		case 'd':
 			full_dynamic = true;
 			break;
@@ -966,9 +1938,15 @@ int main(int argc, char *argv[])
 		w_logf(&ctx, LOG_NOTICE, "Input configuration file: %s\n", config_file);
 	}
 
+	if (!seed_set)
+		ctx.seed = rng_u64();
+	w_logf(&ctx, LOG_NOTICE, "Random seed: %llu\n",
+	       (unsigned long long)ctx.seed);
+
 	INIT_LIST_HEAD(&ctx.stations);
 	if (load_config(&ctx, config_file, per_file, full_dynamic))
 		return EXIT_FAILURE;
+	init_milliwatt_table();
 
 	/* init libevent */
 	event_init();
@@ -1002,11 +1980,31 @@ int main(int argc, char *argv[])
 
 	if (start_server == true)
 		stop_wserver();
+	stop_mobility_thread(&ctx);
 
 	free(ctx.sock);
 	free(ctx.cb);
 	free(ctx.intf);
+	free(ctx.intf_active);
+	free(ctx.intf_dirty);
+	for (i = 0; i < ctx.num_media; i++) {
+		edca_free(ctx.media[i]->edca);
+		free(ctx.media[i]);
+	}
+	free(ctx.media);
+	for (i = 0; i < ctx.antenna_num; i++)
+		free(ctx.antennas[i].name);
+	free(ctx.antennas);
+	free(ctx.sta_antennas);
 	free(ctx.per_matrix);
+	for (i = 0; i < ctx.per_class_num; i++) {
+		free(ctx.per_classes[i].name);
+		free(ctx.per_classes[i].matrix);
+	}
+	free(ctx.per_classes);
+	free(ctx.per_class_matrix);
+	airtime_free(ctx.airtime);
+	correlated_fading_free(&ctx);
 
 	return EXIT_SUCCESS;
 }
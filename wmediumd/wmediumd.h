@@ -40,10 +40,12 @@
 #define HWSIM_ATTR_SIGNAL 6
 #define HWSIM_ATTR_TX_INFO 7
 #define HWSIM_ATTR_COOKIE 8
-#define HWSIM_ATTR_MAX 8
+#define HWSIM_ATTR_FREQ 19
+#define HWSIM_ATTR_MAX 19
 #define VERSION_NR 1
 
 #define SNR_DEFAULT 30
+#define SNR_UNREACHABLE (-100)	/* stations out of range of each other */
 
 #include <stdint.h>
 #include <stdbool.h>
@@ -52,8 +54,10 @@
 
 #include "list.h"
 #include "ieee80211.h"
+#include "rng.h"
 
 typedef uint8_t u8;
+typedef uint32_t u32;
 typedef uint64_t u64;
 
 #define TIME_FMT "%lld.%06lld"
@@ -68,24 +72,55 @@ typedef uint64_t u64;
 
 #define NOISE_LEVEL	(-91)
 #define CCA_THRESHOLD	(-90)
+#define INTF_WINDOW_DEFAULT	(10000)	/* [usec] */
+#define FREQ_UNKNOWN	(0)	/* channel not known yet, matches any */
 
 struct wqueue {
 	struct list_head frames;
+	int aifsn;
 	int cw_min;
 	int cw_max;
+	int txop_limit;			/* [usec], 0 for one frame per TXOP */
+	struct timespec txop_end;	/* of the TXOP of the queue tail */
+	/* A-MPDU of the queue tail with the serial model */
+	struct timespec ampdu_start;
+	int ampdu_num;			/* subframes, 0 for none */
+	int ampdu_len;			/* [bytes] */
+	int ampdu_rate;			/* rate index */
 };
 
 struct station {
 	int index;
 	u8 addr[ETH_ALEN];		/* virtual interface mac address */
 	u8 hwaddr[ETH_ALEN];		/* hardware address of hwsim radio */
-	double x, y;			/* position of the station [m] */
+	double x, y, z;			/* position of the station [m] */
+	int freq;			/* operating frequency [MHz]
+					   or FREQ_UNKNOWN */
 	double dir_x, dir_y;		/* direction of the station [meter per MOVE_INTERVAL] */
 	int tx_power;			/* transmission power [dBm] */
+	bool moved;			/* position or tx_power changed */
+	u32 tx_seq;			/* sequence number of the next frame */
 	struct wqueue queues[IEEE80211_NUM_ACS];
+	struct station **cca_neighbors;	/* stations heard above CCA_THRESHOLD */
+	int cca_num;
+	unsigned long cca_epoch;	/* link_epoch of cca_neighbors */
 	struct list_head list;
 };
 
+/*
+ * Medium of one channel.  Stations on other channels neither delay nor
+ * hear its frames.
+ */
+struct medium {
+	int freq;			/* [MHz] */
+	struct timespec tail[IEEE80211_NUM_ACS];	/* latest delivery of
+							   a frame per AC */
+	struct edca *edca;		/* contention of all queues, or NULL */
+	u64 free;			/* end of the last exchange [usec] */
+	u64 next_round;			/* start of the next contention
+					   round if any [usec] */
+};
+
 struct wmediumd {
 	int timerfd;
 
@@ -95,17 +130,48 @@ struct wmediumd {
 	struct list_head stations;
 	struct station **sta_array;
 	int *snr_matrix;
+	unsigned long link_epoch;	/* bumped whenever link SNRs change,
+					   by continuous mobility only when
+					   a link crosses CCA_THRESHOLD */
 	double *error_prob_matrix;
 	double **station_err_matrix;
-	struct intf_info *intf;
+	struct intf_info *intf;		/* interference caused by each station */
+	int *intf_active;		/* stations on the air in the last window */
+	int intf_num_active;
+	int *intf_dirty;		/* stations on the air in this window */
+	int intf_num_dirty;
+	int intf_window;		/* interference window length [usec] */
 	struct timespec intf_updated;
+	struct airtime *airtime;	/* transmissions on the air for the
+					   overlap interference model, or NULL */
+	bool edca_contention;		/* contend with the edca engine */
+	bool aggregation;		/* send A-MPDUs */
+	struct medium **media;		/* by channel */
+	int num_media;
 #define MOVE_INTERVAL	(3) /* station movement interval [sec] */
 	struct timespec next_move;
 	void *path_loss_param;
+	float *pos_x, *pos_y, *pos_z;	/* station positions by index [m] */
+	int *tx_powers;			/* station tx powers by index [dBm] */
+	float *freq_offsets;		/* 10 * log10(freq / FREQ_1CH) by index,
+					   NULL if all are on FREQ_1CH [dB] */
+	int *snr_matrix_back;		/* next SNR matrix while updating */
+	void *path_loss_state;
+	struct obstacles *obstacles;	/* walls and floors, or NULL */
+	struct antenna_pattern *antennas;
+	int antenna_num;
+	struct station_antenna *sta_antennas;	/* by index, or NULL */
+	void *mobility_trace;
 	float *per_matrix;
 	int per_matrix_row_num;
 	int per_matrix_signal_min;
+	struct per_class *per_classes;
+	int per_class_num;
+	u8 *per_class_matrix;		/* PER class index of each link */
+	u8 per_class_default;
 	int fading_coefficient;
+	void *fading_param;
+	u64 seed;			/* seed of all per-frame random streams */
 
 	struct nl_cb *cb;
 	int family_id;
@@ -116,8 +182,14 @@ struct wmediumd {
 				 struct station *, struct station *);
 	int (*calc_path_loss)(void *, struct station *,
 			      struct station *);
+	void (*calc_path_loss_row)(struct wmediumd *, int, const int *, int,
+				   float *);
+	double (*calc_path_loss_range)(struct wmediumd *, int, int, double);
+	const int *(*get_reachable_stations)(struct wmediumd *,
+					     struct station *, int *);
 	void (*move_stations)(struct wmediumd *);
-	int (*get_fading_signal)(struct wmediumd *);
+	int (*get_fading_signal)(struct wmediumd *, struct station *,
+				 struct station *, struct rng_stream *);
 
 	u8 log_lvl;
 };
@@ -132,11 +204,23 @@ struct frame {
 	struct timespec expires;	/* frame delivery (absolute) */
 	bool acked;
 	u64 cookie;
+	u32 seq;			/* sequence number at the sender */
 	int flags;
 	int signal;
 	int duration;
+	int airtime;			/* of the last attempt [usec] */
 	int tx_rates_count;
+	int freq;			/* [MHz] */
+	struct medium *medium;
 	struct station *sender;
+	bool scheduled;			/* expires is known */
+	/* contention state with the edca engine */
+	struct station *receiver;	/* NULL for multicast */
+	struct rng_stream rng;
+	double choice;
+	u64 tx_start;			/* of the first attempt [usec] */
+	int rate_pos, attempt, attempts;
+	int cw;
 	struct hwsim_tx_rate tx_rates[IEEE80211_TX_MAX_RATES];
 	size_t data_len;
 	u8 data[0];			/* frame contents */
@@ -145,11 +229,37 @@ struct frame {
 struct log_distance_model_param {
 	double path_loss_exponent;
 	double Xg;
+	double PL0;			/* path loss at 1 meter [dB] */
+};
+
+struct two_ray_ground_model_param {
+	double antenna_height;		/* of all stations [m] */
+	double PL0;			/* free-space path loss at 1 meter [dB] */
+};
+
+struct log_normal_shadowing_model_param {
+	double path_loss_exponent;
+	double PL0;			/* path loss at 1 meter [dB] */
+	float *shadowing;		/* quantiles of the shadowing [dB] */
+};
+
+#define PER_CLASS_MAX		(255)
+#define PER_CLASS_NONE		(0xff)	/* use -x table or analytic model */
+
+struct per_class {
+	char *name;
+	float *matrix;
+	int row_num;
+	int signal_min;
 };
 
+/*
+ * Airtime of a station in the current interference window and the share of
+ * the last window it was on the air, as seen by all other stations
+ */
 struct intf_info {
-	int signal;
-	int duration;
+	int signal;			/* of the latest frame [dBm] */
+	int duration;			/* [usec] */
 	double prob_col;
 };
 
@@ -163,6 +273,11 @@ double get_error_prob_from_specific_matrix(struct wmediumd *ctx, double snr,
 										   int frame_len, struct station *src,
 										   struct station *dst);
 int read_per_file(struct wmediumd *ctx, const char *file_name);
+int read_per_class_file(struct wmediumd *ctx, struct per_class *cls,
+			const char *file_name);
+double get_error_prob_from_per_class(struct wmediumd *ctx, double snr,
+				     unsigned int rate_idx, int frame_len,
+				     struct station *src, struct station *dst);
 int w_logf(struct wmediumd *ctx, u8 level, const char *format, ...);
 int w_flogf(struct wmediumd *ctx, u8 level, FILE *stream, const char *format, ...);
 
@@ -22,6 +22,10 @@
 #include <string.h>
 #include <stdlib.h>
 #include "wmediumd_dynamic.h"
+#include "edca.h"
+#include "airtime.h"
+#include "path_loss.h"
+#include "fading.h"
 
 #define DEFAULT_DYNAMIC_SNR -10
 #define DEFAULT_DYNAMIC_ERRPROB 1.0
@@ -35,6 +39,132 @@ pthread_rwlock_t snr_lock = PTHREAD_RWLOCK_INITIALIZER;
     free(matrix_ptr); \
     matrix_ptr = malloc(sizeof(elem_type) * newsize * newsize);
 
+/**
+ * Resize the per-link PER class table
+ * @param ctx The wmediumd context
+ * @param oldnum The old number of stations
+ * @param newnum The new number of stations
+ * @param removed_index The index of the deleted station
+ * @param removed Whether removed_index has to be dropped
+ */
+static void resize_per_class_matrix(struct wmediumd *ctx, size_t oldnum, size_t newnum, size_t removed_index,
+                                    bool removed) {
+    u8 *old_matrix = ctx->per_class_matrix;
+    if (old_matrix == NULL) {
+        return;
+    }
+    ctx->per_class_matrix = malloc(newnum * newnum);
+    memset(ctx->per_class_matrix, ctx->per_class_default, newnum * newnum);
+    size_t xnew = 0;
+    for (size_t x = 0; x < oldnum; x++) {
+        if (removed && x == removed_index) {
+            continue;
+        }
+        size_t ynew = 0;
+        for (size_t y = 0; y < oldnum; y++) {
+            if (removed && y == removed_index) {
+                continue;
+            }
+            ctx->per_class_matrix[xnew * newnum + ynew] = old_matrix[x * oldnum + y];
+            ynew++;
+        }
+        xnew++;
+    }
+    free(old_matrix);
+}
+
+/**
+ * Grow the per-station arrays for an added station
+ * @param ctx The wmediumd context
+ * @param newnum The new number of stations
+ * @return 0 on success, -ENOMEM on error
+ */
+static int grow_station_arrays(struct wmediumd *ctx, size_t newnum) {
+    struct station **sta_array = realloc(ctx->sta_array, newnum * sizeof(*sta_array));
+    if (sta_array == NULL) {
+        return -ENOMEM;
+    }
+    ctx->sta_array = sta_array;
+
+    if (ctx->intf == NULL) {
+        return 0;
+    }
+    struct intf_info *intf = realloc(ctx->intf, newnum * sizeof(*intf));
+    if (intf == NULL) {
+        return -ENOMEM;
+    }
+    ctx->intf = intf;
+    intf[newnum - 1].signal = -200;
+    intf[newnum - 1].duration = 0;
+    intf[newnum - 1].prob_col = 0.0;
+
+    int *active = realloc(ctx->intf_active, newnum * sizeof(*active));
+    if (active == NULL) {
+        return -ENOMEM;
+    }
+    ctx->intf_active = active;
+    int *dirty = realloc(ctx->intf_dirty, newnum * sizeof(*dirty));
+    if (dirty == NULL) {
+        return -ENOMEM;
+    }
+    ctx->intf_dirty = dirty;
+    return 0;
+}
+
+/**
+ * Drop a station from a list of station indices
+ * @param list The station indices
+ * @param num The number of indices
+ * @param index The index of the deleted station
+ * @return The new number of indices
+ */
+static int remove_station_index(int *list, int num, int index) {
+    int n = 0;
+    for (int k = 0; k < num; k++) {
+        if (list[k] == index) {
+            continue;
+        }
+        list[n++] = list[k] > index ? list[k] - 1 : list[k];
+    }
+    return n;
+}
+
+/**
+ * Drop a deleted station from the per-station state of the medium model
+ * @param ctx The wmediumd context
+ * @param station The deleted station
+ * @param index The index of the deleted station
+ * @param newnum The new number of stations
+ */
+static void remove_station_state(struct wmediumd *ctx, struct station *station, size_t index, size_t newnum) {
+    memmove(&ctx->sta_array[index], &ctx->sta_array[index + 1], (newnum - index) * sizeof(*ctx->sta_array));
+
+    if (ctx->intf != NULL) {
+        memmove(&ctx->intf[index], &ctx->intf[index + 1], (newnum - index) * sizeof(*ctx->intf));
+        ctx->intf_num_active = remove_station_index(ctx->intf_active, ctx->intf_num_active, (int) index);
+        ctx->intf_num_dirty = remove_station_index(ctx->intf_dirty, ctx->intf_num_dirty, (int) index);
+    }
+    if (ctx->airtime != NULL) {
+        airtime_remove_sender(ctx->airtime, (int) index);
+    }
+
+    // Contending frames for the deleted station go nowhere, its own frames are dropped
+    struct station *sta_loop;
+    struct frame *frame, *tmp;
+    list_for_each_entry(sta_loop, &ctx->stations, list) {
+        for (int ac = 0; ac < IEEE80211_NUM_ACS; ac++) {
+            list_for_each_entry_safe(frame, tmp, &sta_loop->queues[ac].frames, list) {
+                if (sta_loop == station) {
+                    list_del(&frame->list);
+                    free(frame);
+                } else if (frame->medium->edca != NULL && frame->receiver == station) {
+                    frame->receiver = NULL;
+                }
+            }
+        }
+    }
+}
+
 int add_station(struct wmediumd *ctx, const u8 addr[]) {
     struct station *sta_loop;
     list_for_each_entry(sta_loop, &ctx->stations, list) {
@@ -45,6 +175,10 @@ int add_station(struct wmediumd *ctx, const u8 addr[]) {
     pthread_rwlock_wrlock(&snr_lock);
     size_t oldnum = (size_t) ctx->num_stas;
     size_t newnum = oldnum + 1;
+    int ret = grow_station_arrays(ctx, newnum);
+    if (ret) {
+        goto out;
+    }
 
     // Save old matrix and init new matrix
     union {
@@ -52,7 +186,6 @@ int add_station(struct wmediumd *ctx, const u8 addr[]) {
         double *old_errprob_matrix;
         double **old_station_err_matrix;
     } matrizes;
-    int ret;
     if (ctx->station_err_matrix != NULL) {
         swap_matrix(ctx->station_err_matrix, oldnum, newnum, double*, matrizes.old_station_err_matrix);
     } else if (ctx->error_prob_matrix != NULL) {
@@ -109,6 +242,7 @@ int add_station(struct wmediumd *ctx, const u8 addr[]) {
     } else {
         free(matrizes.old_snr_matrix);
     }
+    resize_per_class_matrix(ctx, oldnum, newnum, 0, false);
 
     // Init new station object
     struct station *station;
@@ -120,10 +254,30 @@ int add_station(struct wmediumd *ctx, const u8 addr[]) {
     station->index = (int) oldnum;
     memcpy(station->addr, addr, ETH_ALEN);
     memcpy(station->hwaddr, addr, ETH_ALEN);
+    station->x = 0.0;
+    station->y = 0.0;
+    station->z = 0.0;
+    station->dir_x = 0.0;
+    station->dir_y = 0.0;
+    station->tx_power = SNR_DEFAULT;
+    station->freq = FREQ_UNKNOWN;
+    station->tx_seq = 0;
+    station->cca_neighbors = NULL;
+    station->cca_num = 0;
+    station->cca_epoch = 0;
+    station->moved = false;
     station_init_queues(station);
     list_add_tail(&station->list, &ctx->stations);
+    ctx->sta_array[oldnum] = station;
     ctx->num_stas = (int) newnum;
+    ctx->link_epoch++;
     ret = station->index;
+    if (ctx->path_loss_state != NULL) {
+        int err = path_loss_add_station(ctx, station);
+        if (err) {
+            ret = err;
+        }
+    }
 
     out:
     pthread_rwlock_unlock(&snr_lock);
@@ -208,11 +362,27 @@ int del_station(struct wmediumd *ctx, struct station *station) {
     } else {
         free(matrizes.old_snr_matrix);
     }
+    resize_per_class_matrix(ctx, oldnum, newnum, index, true);
+
+    for (int i = 0; i < ctx->num_media; i++) {
+        if (ctx->media[i]->edca != NULL) {
+            edca_remove(ctx->media[i]->edca, (int) index * IEEE80211_NUM_ACS, IEEE80211_NUM_ACS);
+        }
+    }
+    remove_station_state(ctx, station, index, newnum);
 
     list_del(&station->list);
     ctx->num_stas = (int) newnum;
+    ctx->link_epoch++;
 
+    free(station->cca_neighbors);
     free(station);
+    if (ctx->get_fading_signal == get_correlated_fading_signal) {
+        correlated_fading_remove_station(ctx, (int) index);
+    }
+    if (ctx->path_loss_state != NULL) {
+        return path_loss_del_station(ctx, (int) index);
+    }
     return 0;
 }
 
@@ -226,9 +396,9 @@ int del_station_by_id(struct wmediumd *ctx, const i32 id) {
             goto out;
         }
     }
+    ret = -ENODEV;
 
     out:
-    ret = -ENODEV;
     pthread_rwlock_unlock(&snr_lock);
     return ret;
 }
@@ -0,0 +1,143 @@
+/*
+ * Small pool of worker threads that run one function in parallel.
+ *
+ * The calling thread takes part as worker 0, so a pool of size 1 runs
+ * everything inline without any thread.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "worker_pool.h"
+
+struct worker_pool {
+	int workers;
+	pthread_t *threads;
+	pthread_mutex_t lock;
+	pthread_cond_t start;
+	pthread_cond_t done;
+	unsigned long generation;	/* bumped for every run */
+	int running;			/* threads busy with this run */
+	bool stop;
+	worker_fn fn;
+	void *arg;
+};
+
+struct worker_arg {
+	struct worker_pool *pool;
+	int worker;
+};
+
+static void *worker_main(void *data)
+{
+	struct worker_arg *warg = data;
+	struct worker_pool *pool = warg->pool;
+	int worker = warg->worker;
+	unsigned long seen = 0;
+
+	free(warg);
+
+	pthread_mutex_lock(&pool->lock);
+	while (1) {
+		while (!pool->stop && pool->generation == seen)
+			pthread_cond_wait(&pool->start, &pool->lock);
+		if (pool->stop)
+			break;
+		seen = pool->generation;
+		pthread_mutex_unlock(&pool->lock);
+
+		pool->fn(pool->arg, worker, pool->workers);
+
+		pthread_mutex_lock(&pool->lock);
+		if (--pool->running == 0)
+			pthread_cond_signal(&pool->done);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+struct worker_pool *worker_pool_create(int workers)
+{
+	struct worker_pool *pool;
+	struct worker_arg *warg;
+	int i;
+
+	if (workers < 1)
+		workers = 1;
+
+	pool = calloc(1, sizeof(*pool));
+	if (!pool)
+		return NULL;
+
+	pool->threads = calloc(workers, sizeof(pthread_t));
+	if (!pool->threads) {
+		free(pool);
+		return NULL;
+	}
+	pool->workers = 1;
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->start, NULL);
+	pthread_cond_init(&pool->done, NULL);
+
+	for (i = 1; i < workers; i++) {
+		warg = malloc(sizeof(*warg));
+		if (!warg)
+			break;
+		warg->pool = pool;
+		warg->worker = i;
+		if (pthread_create(&pool->threads[i], NULL, worker_main,
+				   warg)) {
+			free(warg);
+			break;
+		}
+		pool->workers++;
+	}
+
+	return pool;
+}
+
+void worker_pool_run(struct worker_pool *pool, worker_fn fn, void *arg)
+{
+	pthread_mutex_lock(&pool->lock);
+	pool->fn = fn;
+	pool->arg = arg;
+	pool->running = pool->workers - 1;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->start);
+	pthread_mutex_unlock(&pool->lock);
+
+	fn(arg, 0, pool->workers);
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->running > 0)
+		pthread_cond_wait(&pool->done, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+int worker_pool_size(struct worker_pool *pool)
+{
+	return pool->workers;
+}
+
+void worker_pool_destroy(struct worker_pool *pool)
+{
+	int i;
+
+	if (!pool)
+		return;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stop = true;
+	pthread_cond_broadcast(&pool->start);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 1; i < pool->workers; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->start);
+	pthread_cond_destroy(&pool->done);
+	free(pool->threads);
+	free(pool);
+}
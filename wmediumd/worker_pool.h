@@ -0,0 +1,61 @@
+/*
+ * Small pool of worker threads that run one function in parallel.
+ */
+
+#ifndef WMEDIUMD_WORKER_POOL_H
+#define WMEDIUMD_WORKER_POOL_H
+
+/**
+ * Function run by every worker
+ * @param arg The argument passed to worker_pool_run()
+ * @param worker The index of the worker, 0 is the calling thread
+ * @param workers The number of workers
+ */
+typedef void (*worker_fn)(void *arg, int worker, int workers);
+
+struct worker_pool;
+
+/**
+ * Create a pool
+ * @param workers The number of workers including the calling thread
+ * @return The pool or NULL on error
+ */
+struct worker_pool *worker_pool_create(int workers);
+
+/**
+ * Run a function on all workers and wait until every worker returned
+ * @param pool The pool
+ * @param fn The function
+ * @param arg The argument for fn
+ */
+void worker_pool_run(struct worker_pool *pool, worker_fn fn, void *arg);
+
+/**
+ * Get the number of workers of a pool
+ * @param pool The pool
+ * @return The number of workers including the calling thread
+ */
+int worker_pool_size(struct worker_pool *pool);
+
+/**
+ * Stop all workers and free a pool
+ * @param pool The pool
+ */
+void worker_pool_destroy(struct worker_pool *pool);
+
+/**
+ * Split [0, len) evenly among workers
+ * @param len The length of the range
+ * @param worker The index of the worker
+ * @param workers The number of workers
+ * @param begin Where to store the first index of the worker
+ * @param end Where to store the index after the last one of the worker
+ */
+static inline void worker_range(int len, int worker, int workers,
+				int *begin, int *end)
+{
+	*begin = (int)((long)len * worker / workers);
+	*end = (int)((long)len * (worker + 1) / workers);
+}
+
+#endif //WMEDIUMD_WORKER_POOL_H
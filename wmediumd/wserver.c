@@ -32,6 +32,7 @@
 #include "wserver.h"
 #include "wmediumd_dynamic.h"
 #include "wserver_messages.h"
+#include "path_loss.h"
 
 
 #define LOG_PREFIX "W_SRV: "
@@ -130,7 +131,7 @@ int handle_snr_update_request(struct request_ctx *ctx, const snr_update_request
         struct station *receiver = NULL;
         struct station *station;
 
-        pthread_rwlock_rdlock(&snr_lock);
+        pthread_rwlock_wrlock(&snr_lock);
 
         list_for_each_entry(station, &ctx->ctx->stations, list) {
             if (memcmp(&request->from_addr, station->addr, ETH_ALEN) == 0) {
@@ -149,8 +150,14 @@ int handle_snr_update_request(struct request_ctx *ctx, const snr_update_request
         } else {
             w_logf(ctx->ctx, LOG_NOTICE, LOG_PREFIX "Performing SNR update: from=" MAC_FMT ", to=" MAC_FMT ", snr=%d\n",
                    MAC_ARGS(sender->addr), MAC_ARGS(receiver->addr), request->snr);
-            ctx->ctx->snr_matrix[sender->index * ctx->ctx->num_stas + receiver->index] = request->snr;
-            ctx->ctx->snr_matrix[receiver->index * ctx->ctx->num_stas + sender->index] = request->snr;
+            if (ctx->ctx->path_loss_state != NULL) {
+                // the path loss model carries the SNR over into its next matrix
+                path_loss_set_snr(ctx->ctx, sender->index, receiver->index, request->snr);
+            } else {
+                ctx->ctx->snr_matrix[sender->index * ctx->ctx->num_stas + receiver->index] = request->snr;
+                ctx->ctx->snr_matrix[receiver->index * ctx->ctx->num_stas + sender->index] = request->snr;
+                __atomic_add_fetch(&ctx->ctx->link_epoch, 1, __ATOMIC_RELEASE);
+            }
             response.update_result = WUPDATE_SUCCESS;
         }
         pthread_rwlock_unlock(&snr_lock);
@@ -273,6 +280,10 @@ int handle_delete_by_id_request(struct request_ctx *ctx, station_del_by_id_reque
             w_logf(ctx->ctx, LOG_WARNING, LOG_PREFIX
                     "Station with ID %d could not be found\n", request->id);
             response.update_result = WUPDATE_INTF_NOTFOUND;
+        } else if (ret == -EOPNOTSUPP) {
+            w_logf(ctx->ctx, LOG_WARNING, LOG_PREFIX
+                    "Stations cannot be deleted with a path loss model\n");
+            response.update_result = WUPDATE_WRONG_MODE;
         } else {
             w_logf(ctx->ctx, LOG_ERR, "Error on delete by id request: %s\n", strerror(abs(ret)));
             return WACTION_ERROR;
@@ -299,6 +310,10 @@ int handle_delete_by_mac_request(struct request_ctx *ctx, station_del_by_mac_req
             w_logf(ctx->ctx, LOG_WARNING, LOG_PREFIX
                     "Station with MAC " MAC_FMT " could not be found\n", MAC_ARGS(request->addr));
             response.update_result = WUPDATE_INTF_NOTFOUND;
+        } else if (ret == -EOPNOTSUPP) {
+            w_logf(ctx->ctx, LOG_WARNING, LOG_PREFIX
+                    "Stations cannot be deleted with a path loss model\n");
+            response.update_result = WUPDATE_WRONG_MODE;
         } else {
             w_logf(ctx->ctx, LOG_ERR, "Error %d on delete by mac request: %s\n", ret, strerror(abs(ret)));
             return WACTION_ERROR;
@@ -326,6 +341,11 @@ int handle_add_request(struct request_ctx *ctx, station_add_request *request) {
                     "Station with MAC " MAC_FMT " already exists\n", MAC_ARGS(request->addr));
             response.created_id = 0;
             response.update_result = WUPDATE_INTF_DUPLICATE;
+        } else if (ret == -EOPNOTSUPP) {
+            w_logf(ctx->ctx, LOG_WARNING, LOG_PREFIX
+                    "Stations cannot be added with a path loss model\n");
+            response.created_id = 0;
+            response.update_result = WUPDATE_WRONG_MODE;
         } else {
             w_logf(ctx->ctx, LOG_ERR, "Error on add request: %s\n", strerror(abs(ret)));
             return WACTION_ERROR;